@@ -0,0 +1,186 @@
+// Runs the engines of a session's worth of instances span by span, as a host does, and reports the time per sample
+// with the dTLB and cache misses behind it. Built once per setting of the Arena.h switches (see CMakeLists.txt), so
+// huge pages and read prefetching can be compared on the same machine.
+//
+//   ArenaBench [instances] [seconds]
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"         // the DSP headers are included through it, Engine.h among them
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#if JUCE_LINUX
+ #include <linux/perf_event.h>
+ #include <sys/ioctl.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr double sampleRate = 96000.0;          // where the engines' arenas pass the 2 MB huge-page threshold
+    constexpr int spanSize = 64;                    // as the processor's sub-blocks
+
+    // One plugin instance: both engines as the processor lays them out for the short delay range
+    struct Instance
+    {
+        explicit Instance(int index)
+            : delay({ sampleRate, false, 1, 0, DelayLine::Memory::heap, DelayAudioProcessor::getDelayBufferTime(false) }),
+              reverb({ sampleRate, 1 })
+        {
+            delay.build([] { return false; });
+            reverb.build([] { return false; });
+
+            for (size_t lane = 0; lane < delay.delayLines.size(); ++lane)
+                baseDelayTimes[lane] = 300.f + 53.f * static_cast<float>(index) + 700.f * static_cast<float>(lane);
+        }
+
+        void process(const float* in, const float* lfo, int position)
+        {
+            for (size_t lane = 0; lane < delay.delayLines.size(); ++lane)
+            {
+                for (int i = 0; i < spanSize; ++i)      // a chorus-like wobble, so every span reads per-sample delays
+                    delayTimes[static_cast<size_t>(i)] = baseDelayTimes[lane] + 0.33f * lfo[i] + 0.001f * static_cast<float>(position % 1000);
+
+                delay.delayLines[lane].process(in, wet[lane].data(), spanSize, delayTimes.data(), 0.4f, Interpolation::Quality::linear,
+                                               [](int, float sample) { return sample; }, [](float*, int) {});
+            }
+
+            reverb.lines->process(wet[0].data(), wet[1].data(), reverbOut[0].data(), reverbOut[1].data(), spanSize, 0.5f, lfo);
+        }
+
+        DelayEngine delay;
+        ReverbEngine reverb;
+        std::array<float, 2> baseDelayTimes;
+        std::array<double, spanSize> delayTimes;
+        std::array<std::array<float, spanSize>, 2> wet, reverbOut;
+    };
+
+    //== HARDWARE COUNTERS (Linux perf events for this thread; -1 where they are not available)
+    class Counter
+    {
+    public:
+        Counter(uint32_t type, uint64_t config)
+        {
+           #if JUCE_LINUX
+            perf_event_attr attributes {};
+            attributes.size = sizeof(attributes);
+            attributes.type = type;
+            attributes.config = config;
+            attributes.disabled = 1;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+           #else
+            juce::ignoreUnused(type, config);
+           #endif
+        }
+
+        ~Counter()
+        {
+           #if JUCE_LINUX
+            if (fd >= 0)
+                close(fd);
+           #endif
+        }
+
+        void start()
+        {
+           #if JUCE_LINUX
+            if (fd >= 0)
+            {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+           #endif
+        }
+
+        long long read() const
+        {
+            long long value = -1;
+           #if JUCE_LINUX
+            if (fd >= 0 && ::read(fd, &value, sizeof(value)) != static_cast<ssize_t>(sizeof(value)))
+                value = -1;
+           #endif
+            return value;
+        }
+
+    private:
+        int fd = -1;
+
+        JUCE_DECLARE_NON_COPYABLE(Counter)
+    };
+
+   #if JUCE_LINUX
+    constexpr uint64_t dtlbReadMisses = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    Counter makeDtlbCounter() { return { PERF_TYPE_HW_CACHE, dtlbReadMisses }; }
+    Counter makeCacheCounter() { return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES }; }
+   #else
+    Counter makeDtlbCounter() { return { 0, 0 }; }
+    Counter makeCacheCounter() { return { 0, 0 }; }
+   #endif
+
+    void printPerThousand(const char* name, long long count, double samples)
+    {
+        if (count < 0)
+            std::printf("%-22s n/a\n", name);
+        else
+            std::printf("%-22s %.2f per 1000 samples\n", name, 1000.0 * static_cast<double>(count) / samples);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const juce::ScopedNoDenormals noDenormals;
+    const int numInstances = argc > 1 ? std::atoi(argv[1]) : 24;
+    const double seconds = argc > 2 ? std::atof(argv[2]) : 10.0;
+
+    std::vector<std::unique_ptr<Instance>> instances;
+    for (int index = 0; index < numInstances; ++index)
+        instances.push_back(std::make_unique<Instance>(index));
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+    std::array<float, spanSize> in, lfo;
+    const auto runSpans = [&](int numSpans)
+    {
+        for (int span = 0; span < numSpans; ++span)
+        {
+            for (int i = 0; i < spanSize; ++i)
+            {
+                in[static_cast<size_t>(i)] = distribution(random);
+                lfo[static_cast<size_t>(i)] = std::sin(0.0001f * static_cast<float>(span * spanSize + i));
+            }
+
+            for (auto& instance : instances)
+                instance->process(in.data(), lfo.data(), span);
+        }
+    };
+
+    const int numSpans = static_cast<int>(seconds * sampleRate / spanSize);
+    runSpans(static_cast<int>(sampleRate * 3.0 / spanSize));        // fills the delay memory the reads reach back into
+
+    Counter dtlb = makeDtlbCounter(), cache = makeCacheCounter();
+    dtlb.start();
+    cache.start();
+    const auto start = std::chrono::steady_clock::now();
+    runSpans(numSpans);
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    const long long dtlbMisses = dtlb.read(), cacheMisses = cache.read();
+
+    const double samples = static_cast<double>(numSpans) * spanSize * numInstances;
+    const size_t bytes = instances.front()->delay.arena.getCapacity() + instances.front()->reverb.arena.getCapacity();
+
+    std::printf("huge pages %s, read prefetch %s; %d instances of %.1f MB at %.0f Hz, %.0f s each\n",
+                DSP_ARENA_HUGE_PAGES ? "on" : "off", DSP_PREFETCH_READS ? "on" : "off", numInstances,
+                static_cast<double>(bytes) / (1 << 20), sampleRate, seconds);
+    std::printf("%-22s %.2f ns per instance sample\n", "time", elapsed.count() / samples);
+    printPerThousand("dTLB read misses", dtlbMisses, samples);
+    printPerThousand("cache misses", cacheMisses, samples);
+    return 0;
+}
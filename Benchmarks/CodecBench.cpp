@@ -0,0 +1,141 @@
+// Measures the delay storage formats (see StorageCodec in DelayLine.h): for each, the time a line takes per sample,
+// the memory its buffer holds, and the noise the format adds to what is stored. Run from a release build.
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"         // the DSP headers are included through it, DelayLine.h among them
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    const float bufferTime = DelayAudioProcessor::getDelayBufferTime(false);      // ms, as the processor's lines without "Long Delay"
+    constexpr int spanSize = 64;                    // as the processor's sub-blocks
+    constexpr double timedSeconds = 20.0;
+
+    // A heap line in the given format, laid out as DelayEngine does
+    struct Line
+    {
+        explicit Line(StorageCodec::Format format)
+        {
+            line.setSampleRate(sampleRate);
+            line.setStorageFormat(format);
+            line.setMemory(DelayLine::Memory::heap);
+            arena.reset(line.getArenaBytes(bufferTime));
+            line.makeBuffer(bufferTime, arena);
+        }
+
+        // Runs in through the line a span at a time; delayTime(i) gives the delay (ms) at sample i
+        template <typename DelayTime>
+        void run(const std::vector<float>& in, std::vector<float>& out, float feedback, Interpolation::Quality quality, DelayTime&& delayTime)
+        {
+            std::array<double, spanSize> delayTimes;
+
+            for (size_t start = 0; start + spanSize <= in.size(); start += spanSize)
+            {
+                for (int i = 0; i < spanSize; ++i)
+                    delayTimes[static_cast<size_t>(i)] = delayTime(start + static_cast<size_t>(i));
+
+                line.process(in.data() + start, out.data() + start, spanSize, delayTimes.data(), feedback, quality,
+                             [](int, float sample) { return sample; }, [](float*, int) {});
+            }
+        }
+
+        DspArena arena;
+        DelayLine line;
+    };
+
+    std::vector<float> makeNoise(size_t numSamples, float level)
+    {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> distribution(-level, level);
+        std::vector<float> noise(numSamples);
+        for (auto& sample : noise)
+            sample = distribution(random);
+        return noise;
+    }
+
+    double toDecibels(double gain) { return 20.0 * std::log10(gain); }     // -inf for a lossless format
+
+    //== CPU (ns per sample, one line; a fixed delay takes the block path, a modulated one reads between samples)
+    double measureTime(StorageCodec::Format format, bool modulated)
+    {
+        Line line(format);
+        const std::vector<float> in = makeNoise(static_cast<size_t>(timedSeconds * sampleRate), 0.5f);
+        std::vector<float> out(in.size());
+        const float radiansPerSample = static_cast<float>(juce::MathConstants<double>::twoPi * 0.5 / sampleRate);
+        const auto delayTime = [modulated, radiansPerSample](size_t i)
+        {
+            return modulated ? 500.f + 20.f * std::sin(radiansPerSample * static_cast<float>(i)) : 500.f;
+        };
+
+        line.run(in, out, 0.5f, Interpolation::Quality::linear, delayTime);      // warm up: caches, pages, branch history
+
+        const auto start = std::chrono::steady_clock::now();
+        line.run(in, out, 0.5f, Interpolation::Quality::linear, delayTime);
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / static_cast<double>(in.size());
+    }
+
+    //== NOISE FLOOR (what storing adds: a whole-sample delay with no feedback reads back exactly what was stored)
+    struct Noise
+    {
+        double errorDb;                             // dBFS
+        double signalToNoiseDb;
+    };
+
+    Noise measureNoise(StorageCodec::Format format, float level)
+    {
+        constexpr float delayTime = 10.f;           // ms, a whole number of samples at sampleRate
+        const size_t delaySamples = static_cast<size_t>(delayTime * sampleRate / 1000.0) + 1;    // a span is read before it is written
+
+        Line line(format);
+        const std::vector<float> in = makeNoise(static_cast<size_t>(sampleRate), level);
+        std::vector<float> out(in.size());
+        line.run(in, out, 0.f, Interpolation::Quality::none, [](size_t) { return delayTime; });
+
+        double signal = 0.0, error = 0.0;
+        for (size_t i = delaySamples; i < in.size(); ++i)
+        {
+            const double stored = in[i - delaySamples];
+            signal += stored * stored;
+            error += (out[i] - stored) * (out[i] - stored);
+        }
+
+        const double count = static_cast<double>(in.size() - delaySamples);
+        return { toDecibels(std::sqrt(error / count)), toDecibels(std::sqrt(signal / error)) };
+    }
+}
+
+int main()
+{
+    const juce::ScopedNoDenormals noDenormals;
+
+    const std::pair<StorageCodec::Format, const char*> formats[] = {
+        { StorageCodec::Format::float32, "float32" },
+        { StorageCodec::Format::float16, "float16" },
+        { StorageCodec::Format::bfloat16, "bfloat16" },
+        { StorageCodec::Format::int16, "int16" }
+    };
+
+    std::printf("%.0f Hz, %.0f ms buffer, spans of %d; noise floor of white noise at -6 and -60 dBFS\n\n", sampleRate, bufferTime, spanSize);
+    std::printf("%-9s %12s %14s %16s %16s %16s\n", "format", "buffer", "fixed ns/smp", "modulated ns/smp", "floor @-6 dBFS", "floor @-60 dBFS");
+
+    for (const auto& [format, name] : formats)
+    {
+        Line line(format);
+        const Noise loud = measureNoise(format, 0.5f);
+        const Noise quiet = measureNoise(format, 0.001f);
+
+        std::printf("%-9s %9.0f kB %14.2f %16.2f %8.1f (%5.1f) %8.1f (%5.1f)\n", name,
+                    static_cast<double>(line.arena.getUsedBytes()) / 1024.0, measureTime(format, false), measureTime(format, true),
+                    loud.errorDb, loud.signalToNoiseDb, quiet.errorDb, quiet.signalToNoiseDb);
+    }
+
+    std::printf("\nfloors are the error RMS in dBFS, with the signal to noise ratio in dB in brackets\n");
+    return 0;
+}
@@ -0,0 +1,133 @@
+// Sweeps a long delay across its whole range in real time and counts the page faults taken on the processing thread,
+// which stand in for the audio thread. With mapped memory (see MappedRingMemory) the prefault thread should keep
+// them away; paged memory is there to compare, with providePages called on a 50 ms timer as the processor does.
+//
+//   MappedFaultStress [mapped|paged] [seconds]
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"         // the DSP headers are included through it, DelayLine.h among them
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#if JUCE_LINUX
+ #include <sys/resource.h>
+#endif
+
+#if JUCE_LINUX
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr float longestDelay = 60000.f;         // ms, the "Long Delay" range
+    constexpr int spanSize = 64;                    // as the processor's sub-blocks
+    constexpr int blockSize = 512;                  // paced like a host block
+    constexpr int serviceInterval = 50;             // ms, as the processor's timer
+    constexpr double warmUpTime = 1.0;              // s of faults not counted while the first pages are set up
+
+    struct Faults
+    {
+        long minor = 0, major = 0;
+    };
+
+    Faults getThreadFaults()
+    {
+        rusage usage {};
+        getrusage(RUSAGE_THREAD, &usage);
+        return { usage.ru_minflt, usage.ru_majflt };
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const bool paged = argc > 1 && std::strcmp(argv[1], "paged") == 0;
+    const double seconds = argc > 2 ? std::atof(argv[2]) : 30.0;
+
+    DspArena arena;
+    DelayLine line;
+    line.setSampleRate(sampleRate);
+    line.setMemory(paged ? DelayLine::Memory::paged : DelayLine::Memory::mapped);
+    arena.reset(line.getArenaBytes(longestDelay + 1.f));
+    line.makeBuffer(longestDelay + 1.f, arena);
+
+    std::atomic<bool> done { false };
+    std::thread service([&]
+    {
+        while (! done.load())
+        {
+            line.providePages();
+            std::this_thread::sleep_for(std::chrono::milliseconds(serviceInterval));
+        }
+    });
+
+    Faults counted, warmUp;
+    long spans = 0, faultySpans = 0;
+    double worstSpan = 0.0;
+
+    std::thread processing([&]
+    {
+        const long numSamples = static_cast<long>(seconds * sampleRate);
+        const long warmUpSamples = static_cast<long>(warmUpTime * sampleRate);
+        std::array<float, spanSize> in, out;
+        std::array<double, spanSize> delayTimes;
+        auto nextBlock = std::chrono::steady_clock::now();
+
+        for (long start = 0; start < numSamples; start += spanSize)
+        {
+            // the delay goes out to the longest and back once over the run, so reads cross every page
+            for (int i = 0; i < spanSize; ++i)
+            {
+                const double position = static_cast<double>(start + i) / static_cast<double>(numSamples);
+                delayTimes[static_cast<size_t>(i)] = longestDelay * (1.0 - std::abs(2.0 * position - 1.0));
+                in[static_cast<size_t>(i)] = static_cast<float>(std::sin(0.01 * static_cast<double>(start + i)));
+            }
+
+            const Faults before = getThreadFaults();
+            const auto spanStart = std::chrono::steady_clock::now();
+            line.process(in.data(), out.data(), spanSize, delayTimes.data(), 0.5f, Interpolation::Quality::linear,
+                         [](int, float sample) { return sample; }, [](float*, int) {});
+            const std::chrono::duration<double, std::micro> spanTime = std::chrono::steady_clock::now() - spanStart;
+            const Faults after = getThreadFaults();
+
+            Faults& faults = start < warmUpSamples ? warmUp : counted;
+            faults.minor += after.minor - before.minor;
+            faults.major += after.major - before.major;
+
+            if (start >= warmUpSamples)
+            {
+                ++spans;
+                faultySpans += after.minor != before.minor || after.major != before.major;
+                worstSpan = juce::jmax(worstSpan, spanTime.count());
+            }
+
+            if ((start + spanSize) % blockSize == 0)
+            {
+                nextBlock += std::chrono::microseconds(static_cast<long>(1.0e6 * blockSize / sampleRate));
+                std::this_thread::sleep_until(nextBlock);
+            }
+        }
+    });
+
+    processing.join();
+    done = true;
+    service.join();
+
+    std::printf("%s memory, %.0f ms delay swept out and back over %.0f s\n", paged ? "paged" : "mapped", longestDelay, seconds);
+    std::printf("first %.0f s:   %ld minor, %ld major faults\n", warmUpTime, warmUp.minor, warmUp.major);
+    std::printf("after that:   %ld minor, %ld major faults, in %ld of %ld spans; worst span %.0f us\n",
+                counted.minor, counted.major, faultySpans, spans, worstSpan);
+    return 0;
+}
+
+#else
+
+int main()
+{
+    std::printf("needs Linux: mapped delay memory and per-thread fault counts are only available there\n");
+    return 0;
+}
+
+#endif
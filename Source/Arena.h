@@ -0,0 +1,254 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <sys/mman.h>
+ #include <unistd.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+ #include <xmmintrin.h>
+#endif
+
+// Build switches, both off until Benchmarks/ArenaBench shows a gain on the machines that matter: huge-page backing
+// for large arenas, and prefetching of the regions read heads move into
+#ifndef DSP_ARENA_HUGE_PAGES
+ #define DSP_ARENA_HUGE_PAGES 0
+#endif
+
+#ifndef DSP_PREFETCH_READS
+ #define DSP_PREFETCH_READS 0
+#endif
+
+// One cache-line aligned allocation for a group of DSP objects and the memory they run on (the filters, each engine),
+// so their state sits together and its footprint is known up front. The owner adds up what it will create
+// (getBytesFor and the components' getArenaBytes), resets the arena to that size, then creates everything in order.
+// The memory is only replaced when a layout needs more than it holds. With DSP_ARENA_HUGE_PAGES, arenas of 2 MB and
+// up start on a 2 MB boundary and ask Linux for transparent huge pages, so delay reads far from the write heads stay
+// within a few TLB entries; otherwise, elsewhere, or when the kernel declines, they are on normal pages.
+// release() hands the memory to a process-wide pool (see DspArena::Pool), where the next reset asking for the same
+// size, in this instance or another, takes it back instead of allocating. Only deactivation releases; arenas that
+// are merely replaced are freed with their owner.
+class DspArena
+{
+public:
+	static constexpr size_t alignment = 64;			// cache line; every block starts on one
+	static constexpr size_t hugePageSize = size_t(2) << 20;
+	static constexpr int maxObjects = 8;
+
+	DspArena() = default;
+	~DspArena() { clear(); }
+
+	// Bytes count objects of T take in the arena, padded to whole cache lines
+	template <typename T>
+	static constexpr size_t getBytesFor(size_t count = 1)
+	{
+		return (count * sizeof(T) + alignment - 1) & ~(alignment - 1);
+	}
+
+	// Destroys what was created and makes room for numBytes
+	void reset(size_t numBytes)
+	{
+		clear();
+
+		if (numBytes > capacity)
+		{
+			memory = Pool::getInstance().take(numBytes);
+			capacity = numBytes;
+
+			if (memory != nullptr)
+				return;
+
+			const size_t memoryAlignment = DSP_ARENA_HUGE_PAGES && numBytes >= hugePageSize ? hugePageSize : alignment;
+			memory = Memory(static_cast<char*>(::operator new(numBytes, std::align_val_t(memoryAlignment))), AlignedDelete { memoryAlignment });
+
+		   #if JUCE_LINUX && DSP_ARENA_HUGE_PAGES
+			if (memoryAlignment == hugePageSize)
+				madvise(memory.get(), numBytes, MADV_HUGEPAGE);
+		   #endif
+		}
+	}
+
+	// Destroys what was created and gives the memory to the pool, for when the instance is deactivated
+	void release()
+	{
+		clear();
+
+		if (memory != nullptr)
+			Pool::getInstance().give(std::move(memory), capacity);
+
+		capacity = 0;
+	}
+
+	// Destroys created objects, newest first. Their memory is handed out again after the next reset.
+	void clear()
+	{
+		while (numObjects > 0)
+		{
+			const Created& created = objects[static_cast<size_t>(--numObjects)];
+			created.destroy(created.object);
+		}
+
+		used.store(0, std::memory_order_relaxed);
+	}
+
+	// Uninitialised room for count trivially constructible values
+	template <typename T>
+	T* allocate(size_t count)
+	{
+		static_assert(std::is_trivially_destructible_v<T> && alignof(T) <= alignment);
+		const size_t numBytes = getBytesFor<T>(count);
+		const size_t offset = used.load(std::memory_order_relaxed);
+		jassert(offset + numBytes <= capacity);	// the layout needs more than reset was told
+		used.store(offset + numBytes, std::memory_order_relaxed);
+		return reinterpret_cast<T*>(memory.get() + offset);
+	}
+
+	// Constructs a T in the arena; it is destroyed by the next reset or clear. Its constructor may allocate
+	// from the arena too, after the object itself.
+	template <typename T, typename... Args>
+	T* create(Args&&... args)
+	{
+		static_assert(alignof(T) <= alignment);
+		jassert(numObjects < maxObjects);
+		const size_t numBytes = getBytesFor<T>();
+		const size_t offset = used.load(std::memory_order_relaxed);
+		jassert(offset + numBytes <= capacity);
+		char* const place = memory.get() + offset;
+		used.store(offset + numBytes, std::memory_order_relaxed);
+		T* const object = new (place) T(std::forward<Args>(args)...);
+		objects[static_cast<size_t>(numObjects++)] = { object, [](void* o) { static_cast<T*>(o)->~T(); } };
+		return object;
+	}
+
+	size_t getCapacity() const { return capacity; }		// bytes held
+	size_t getUsedBytes() const { return used.load(std::memory_order_relaxed); }		// bytes the current layout takes; any thread
+
+private:
+	struct AlignedDelete
+	{
+		size_t memoryAlignment;
+		void operator()(char* block) const { ::operator delete(block, std::align_val_t(memoryAlignment)); }
+	};
+
+	using Memory = std::unique_ptr<char, AlignedDelete>;
+
+	// Released arena memory, shared by every instance in the process. Hosts deactivate instances on muted or frozen
+	// tracks; their memory waits here, with its pages given back to the system (MADV_FREE where available), until a
+	// reset of exactly the same size takes it, which is what reactivating the same layout asks for. That saves the
+	// allocation only: pages the system did reclaim fault back in, as zeros, when they are next written. The oldest
+	// blocks are freed outright to keep the pool within maxBytes, and larger blocks are never kept.
+	class Pool
+	{
+	public:
+		static constexpr size_t maxBytes = size_t(64) << 20;
+
+		static Pool& getInstance()
+		{
+			static Pool pool;
+			return pool;
+		}
+
+		Memory take(size_t numBytes)
+		{
+			const juce::ScopedLock lock(blocksLock);
+
+			for (auto block = blocks.begin(); block != blocks.end(); ++block)
+			{
+				if (block->numBytes == numBytes)
+				{
+					Memory taken = std::move(block->memory);
+					blocks.erase(block);
+					pooledBytes -= numBytes;
+					return taken;
+				}
+			}
+
+			return Memory(nullptr, AlignedDelete { alignment });
+		}
+
+		void give(Memory memory, size_t numBytes)
+		{
+			if (numBytes > maxBytes)
+				return;
+
+			adviseFree(memory.get(), numBytes);
+
+			const juce::ScopedLock lock(blocksLock);
+			while (pooledBytes + numBytes > maxBytes)
+			{
+				pooledBytes -= blocks.front().numBytes;
+				blocks.erase(blocks.begin());
+			}
+
+			blocks.push_back({ std::move(memory), numBytes });
+			pooledBytes += numBytes;
+		}
+
+	private:
+		// Lets the system reclaim the whole pages inside a block; they read back as zeros or as they were, and the
+		// reclaimed ones fault in again
+		static void adviseFree(char* block, size_t numBytes)
+		{
+		   #if (JUCE_LINUX || JUCE_MAC) && defined(MADV_FREE)
+			const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+			const uintptr_t first = (reinterpret_cast<uintptr_t>(block) + pageSize - 1) & ~(pageSize - 1);
+			const uintptr_t last = (reinterpret_cast<uintptr_t>(block) + numBytes) & ~(pageSize - 1);
+			if (last > first)
+				madvise(reinterpret_cast<void*>(first), last - first, MADV_FREE);
+		   #else
+			juce::ignoreUnused(block, numBytes);
+		   #endif
+		}
+
+		struct Block
+		{
+			Memory memory;
+			size_t numBytes;
+		};
+
+		juce::CriticalSection blocksLock;
+		std::vector<Block> blocks;					// oldest first
+		size_t pooledBytes = 0;
+	};
+
+	struct Created
+	{
+		void* object = nullptr;
+		void (*destroy)(void*) = nullptr;
+	};
+
+	Memory memory { nullptr, AlignedDelete { alignment } };
+	size_t capacity = 0;
+	std::atomic<size_t> used { 0 };			// written by the owner only; atomic so getUsedBytes can be read from anywhere
+	std::array<Created, maxObjects> objects;
+	int numObjects = 0;
+
+	JUCE_DECLARE_NON_COPYABLE(DspArena)
+};
+
+//==============================================================================
+
+// Hints that numBytes from address will be read soon, one cache line at a time. Block paths use it for the region
+// their read heads move into next, which is far from the write head and so rarely in cache. A no-op without
+// DSP_PREFETCH_READS.
+inline void prefetchForRead(const void* address, size_t numBytes)
+{
+   #if DSP_PREFETCH_READS
+	const char* const start = static_cast<const char*>(address);
+
+	for (size_t offset = 0; offset < numBytes; offset += DspArena::alignment)
+	{
+	   #if defined(__GNUC__) || defined(__clang__)
+		__builtin_prefetch(start + offset, 0, 3);
+	   #elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		_mm_prefetch(start + offset, _MM_HINT_T0);
+	   #else
+		juce::ignoreUnused(start);
+	   #endif
+	}
+   #else
+	juce::ignoreUnused(address, numBytes);
+   #endif
+}
@@ -1,15 +1,235 @@
 #pragma once
 
 #include "PluginProcessor.h"
+#include "Filters.h"
 
-template <typename T>
+#if JUCE_LINUX
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <unistd.h>
+#endif
+
+// Half-precision conversion instructions, when the target is built for them (F16C comes with AVX2; NEON on AArch64)
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+ #include <immintrin.h>
+ #define DSP_HALF_CONVERSIONS_F16C 1
+#elif defined(__aarch64__) && ! defined(_MSC_VER)
+ #include <arm_neon.h>
+ #define DSP_HALF_CONVERSIONS_NEON 1
+#endif
+
+//==============================================================================
+
+// Fractional-delay read kernels for CircularBuffer. Each policy names the taps it needs around the integer
+// delay (taps[newestTap] is the sample at that delay, later taps are older) and evaluates them in T.
+// evaluate() is plain arithmetic on the gathered taps, so it vectorizes when a block of reads is batched.
+namespace Interpolation
+{
+	enum class Quality { none, linear, cubic, lagrange, thiran };
+
+	struct None
+	{
+		static constexpr int numTaps = 1;
+		static constexpr int newestTap = 0;
+
+		template <typename T>
+		static T evaluate(const T* taps, T, T&) { return taps[0]; }
+	};
+
+	struct Linear
+	{
+		static constexpr int numTaps = 2;
+		static constexpr int newestTap = 0;
+
+		template <typename T>
+		static T evaluate(const T* taps, T fraction, T&) { return taps[0] + fraction * (taps[1] - taps[0]); }
+	};
+
+	// Catmull-Rom cubic Hermite over delays n-1 .. n+2
+	struct CubicHermite
+	{
+		static constexpr int numTaps = 4;
+		static constexpr int newestTap = 1;
+
+		template <typename T>
+		static T evaluate(const T* taps, T fraction, T&)
+		{
+			const T c1 = T(0.5) * (taps[2] - taps[0]);
+			const T c2 = taps[0] - T(2.5) * taps[1] + T(2) * taps[2] - T(0.5) * taps[3];
+			const T c3 = T(0.5) * (taps[3] - taps[0]) + T(1.5) * (taps[1] - taps[2]);
+			return ((c3 * fraction + c2) * fraction + c1) * fraction + taps[1];
+		}
+	};
+
+	// Third-order Lagrange over delays n-1 .. n+2
+	struct Lagrange
+	{
+		static constexpr int numTaps = 4;
+		static constexpr int newestTap = 1;
+
+		template <typename T>
+		static T evaluate(const T* taps, T fraction, T&)
+		{
+			const T dm1 = fraction + T(1), d1 = fraction - T(1), d2 = fraction - T(2);
+			return d1 * d2 * (T(-1.0 / 6.0) * fraction * taps[0] + T(0.5) * dm1 * taps[1])
+				 + dm1 * fraction * (T(-0.5) * d2 * taps[2] + T(1.0 / 6.0) * d1 * taps[3]);
+		}
+	};
+
+	// First-order Thiran allpass. Recursive, so state carries the previous output between reads of one head.
+	// The allpass delay is kept in [0.5, 1.5) so its coefficient stays well inside the unit circle.
+	struct Thiran
+	{
+		static constexpr int numTaps = 3;
+		static constexpr int newestTap = 1;
+
+		template <typename T>
+		static T evaluate(const T* taps, T fraction, T& state)
+		{
+			const bool shift = fraction < T(0.5);
+			const T allpassDelay = shift ? fraction + T(1) : fraction;
+			const T newer = shift ? taps[0] : taps[1];
+			const T older = shift ? taps[1] : taps[2];
+			const T a = (T(1) - allpassDelay) / (T(1) + allpassDelay);
+			state = a * (newer - state) + older;
+			return state;
+		}
+	};
+}
+
+//==============================================================================
+
+// Sample formats for delay memory. Processing stays in float; a codec only decides how samples are stored.
+// encode/decode are branch-free bit arithmetic, so block loops over them vectorize.
+namespace StorageCodec
+{
+	// The 16-bit formats trade CPU for memory: they halve a line's buffer, but converting still costs more than
+	// float32's plain copies (see Benchmarks/CodecBench.cpp). Int16's noise floor is absolute, the others' relative.
+	enum class Format { float32, float16, bfloat16, int16 };
+
+	inline uint32_t toBits(float value) { uint32_t bits; memcpy(&bits, &value, sizeof(bits)); return bits; }
+	inline float fromBits(uint32_t bits) { float value; memcpy(&value, &bits, sizeof(value)); return value; }
+
+	struct Float32
+	{
+		using Stored = float;
+		static float encode(float sample) { return sample; }
+		static float decode(float stored) { return stored; }
+	};
+
+	// IEEE 754 half precision, round to nearest even; about 66 dB of resolution below each sample's own level
+	struct Float16
+	{
+		using Stored = uint16_t;
+
+		static Stored encode(float sample)
+		{
+			uint32_t bits = toBits(sample);
+			const uint32_t sign = bits & 0x80000000u;
+			bits ^= sign;
+
+			// both roundings are always computed and picked by mask: a select around the float add would stay a branch
+			// under strict floating point, and keep encodeRun from vectorizing
+			const uint32_t subnormal = toBits(fromBits(bits) + 0.5f) - toBits(0.5f);
+			const uint32_t normal = (bits + 0xc8000fffu + ((bits >> 13) & 1u)) >> 13;
+			const uint32_t isSubnormal = 0u - static_cast<uint32_t>(bits < 0x38800000u);
+			const uint32_t isOverflow = 0u - static_cast<uint32_t>(bits >= 0x47800000u);     // 65536 and up saturate to infinity
+			const uint32_t finite = (subnormal & isSubnormal) | (normal & ~isSubnormal);
+			const uint32_t half = (0x7c00u & isOverflow) | (finite & ~isOverflow);
+			return static_cast<Stored>(half | (sign >> 16));
+		}
+
+		static float decode(Stored stored)
+		{
+			const float magnitude = fromBits((static_cast<uint32_t>(stored) & 0x7fffu) << 13) * fromBits(0x77800000u);
+			return fromBits(toBits(magnitude) | ((static_cast<uint32_t>(stored) & 0x8000u) << 16));
+		}
+
+		// Convert the leading part of a run with the half-precision instructions, where there are any, and return
+		// how many samples that was; encode/decode take the rest. Codes and values match, except that the instructions
+		// read the infinity code as infinity rather than decode's 65536.
+		static int encodeWide(Stored* stored, const float* input, int numSamples)
+		{
+			int i = 0;
+		   #if DSP_HALF_CONVERSIONS_F16C
+			for (; i + 8 <= numSamples; i += 8)
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(stored + i), _mm256_cvtps_ph(_mm256_loadu_ps(input + i), _MM_FROUND_TO_NEAREST_INT));
+		   #elif DSP_HALF_CONVERSIONS_NEON
+			for (; i + 4 <= numSamples; i += 4)
+				vst1_u16(stored + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(input + i))));
+		   #else
+			juce::ignoreUnused(stored, input, numSamples);
+		   #endif
+			return i;
+		}
+
+		static int decodeWide(float* output, const Stored* stored, int numSamples)
+		{
+			int i = 0;
+		   #if DSP_HALF_CONVERSIONS_F16C
+			for (; i + 8 <= numSamples; i += 8)
+				_mm256_storeu_ps(output + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(stored + i))));
+		   #elif DSP_HALF_CONVERSIONS_NEON
+			for (; i + 4 <= numSamples; i += 4)
+				vst1q_f32(output + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(stored + i))));
+		   #else
+			juce::ignoreUnused(output, stored, numSamples);
+		   #endif
+			return i;
+		}
+	};
+
+	// Upper half of a float, round to nearest even: full float range, 8 bits of mantissa
+	struct BFloat16
+	{
+		using Stored = uint16_t;
+
+		static Stored encode(float sample)
+		{
+			const uint32_t bits = toBits(sample);
+			return static_cast<Stored>((bits + 0x7fffu + ((bits >> 16) & 1u)) >> 16);
+		}
+
+		static float decode(Stored stored) { return fromBits(static_cast<uint32_t>(stored) << 16); }
+	};
+
+	// Fixed point with 12 dB of headroom above full scale; louder feedback peaks clip. Unlike the float formats its
+	// noise floor is absolute, about -89 dBFS: fine for a loud repeat, but a tail at -60 dBFS keeps only ~24 dB of SNR
+	struct Int16
+	{
+		using Stored = int16_t;
+		static constexpr float fullScale = 4.f;
+
+		// rounds before limiting, which gives the same codes as limiting first but leaves a loop the compiler vectorizes
+		static Stored encode(float sample)
+		{
+			const float scaled = sample * (32767.f / fullScale);
+			return static_cast<Stored>(juce::jlimit(-32767.f, 32767.f, scaled + (scaled < 0.f ? -0.5f : 0.5f)));
+		}
+
+		static float decode(Stored stored) { return static_cast<float>(stored) * (fullScale / 32767.f); }
+	};
+
+}
+
+//==============================================================================
+
+template <typename T, typename Codec = StorageCodec::Float32>
 class CircularBuffer
 {
 public:
+	using Stored = typename Codec::Stored;
+
 	CircularBuffer() {}
 	~CircularBuffer() {}
 
-	void flushBuffer(){ memset(&buffer[0], 0, bufferLength * sizeof(T)); }
+	void flushBuffer(){ memset(&buffer[0], 0, bufferLength * sizeof(Stored)); }
+
+	void releaseBuffer()
+	{
+		ownedBuffer.reset();
+		buffer = nullptr;
+	}
 
 	void createCircularBuffer(unsigned int _bufferLength)
 	{
@@ -19,15 +239,31 @@ public:
 	void createCircularBufferPowerOfTwo(unsigned int _bufferLengthPowerOfTwo)
 	{
 		writeIndex = 0;
+		allpassState = 0;
 		bufferLength = _bufferLengthPowerOfTwo;
 		wrapMask = bufferLength - 1;
-		buffer.reset(new T[bufferLength]);
+		ownedBuffer.reset(new Stored[bufferLength]);
+		buffer = ownedBuffer.get();
 		flushBuffer();
 	}
 
+	// Runs on memory owned elsewhere, which must outlive its use here; the length must be a power of two.
+	// Memory known to read as zeros (a fresh mapping) is left untouched, so its pages stay clean until written.
+	void useExternalBuffer(Stored* memory, unsigned int _bufferLengthPowerOfTwo, bool alreadyZeroed = false)
+	{
+		ownedBuffer.reset();
+		writeIndex = 0;
+		allpassState = 0;
+		bufferLength = _bufferLengthPowerOfTwo;
+		wrapMask = bufferLength - 1;
+		buffer = memory;
+		if (! alreadyZeroed)
+			flushBuffer();
+	}
+
 	void writeBuffer(T input)
 	{
-		buffer[writeIndex++] = input;
+		buffer[writeIndex++] = Codec::encode(input);
 		writeIndex &= wrapMask;
 	}
 
@@ -35,34 +271,644 @@ public:
 	{
 		int readIndex = (writeIndex - 1) - delayInSamples;
 		readIndex &= wrapMask;
-		return buffer[readIndex];
+		return Codec::decode(buffer[readIndex]);
 	}
 
+	template <typename Interpolator = Interpolation::Linear>
 	T readBuffer(double delayInFractionalSamples)
 	{
-		T y1 = readBuffer((int)delayInFractionalSamples);
-		if (!interpolate) return y1;
-		T y2 = readBuffer((int)delayInFractionalSamples + 1);
-		double fraction = delayInFractionalSamples - (int)delayInFractionalSamples;
-		return static_cast<T>(doLinearInterpolation(y1, y2, fraction));
+		if (!interpolate) return readBuffer((int)delayInFractionalSamples);
+		const int wholeDelay = static_cast<int>(delayInFractionalSamples);
+		const unsigned int readIndex = (writeIndex - 1 - static_cast<unsigned int>(wholeDelay)) & wrapMask;
+		return readTaps<Interpolator>(buffer, readIndex, static_cast<T>(delayInFractionalSamples - wholeDelay));
 	}
 
-	inline double doLinearInterpolation(double y1, double y2, double fractional_X)
-    {
-        if (fractional_X >= 1.0) return y2;
-        return fractional_X*y2 + (1.0 - fractional_X)*y1;
-    }
+	//==============================================================================
+
+	// A contiguous run of buffer memory. Block accessors return two of these, split where the block wraps;
+	// the second is empty when it doesn't.
+	struct Span
+	{
+		Stored* data = nullptr;
+		int size = 0;
+	};
+
+	using Spans = std::array<Span, 2>;
+
+	// The numSamples samples that per-sample reads at delayInSamples would return over the next numSamples
+	// samples, oldest first. Valid when the block is read before it is written, i.e. delayInSamples >= numSamples - 1.
+	Spans getReadSpans(int delayInSamples, int numSamples)
+	{
+		return makeSpans((writeIndex - 1 - static_cast<unsigned int>(delayInSamples)) & wrapMask, numSamples);
+	}
+
+	// The next numSamples slots to be written; commit them with advanceWriteIndex once filled
+	Spans getWriteSpans(int numSamples)
+	{
+		return makeSpans(writeIndex, numSamples);
+	}
+
+	void advanceWriteIndex(int numSamples)
+	{
+		writeIndex = (writeIndex + static_cast<unsigned int>(numSamples)) & wrapMask;
+	}
+
+	void readBlock(T* output, int delayInSamples, int numSamples)
+	{
+		const Spans spans = getReadSpans(delayInSamples, numSamples);
+		decodeRun(output, spans[0].data, spans[0].size);
+		decodeRun(output + spans[0].size, spans[1].data, spans[1].size);
+	}
+
+	// Constant fractional delay: (1 - fraction) * (delay n) + fraction * (delay n + 1), straight from buffer memory
+	void readBlock(T* output, double delayInFractionalSamples, int numSamples)
+	{
+		const int wholeDelay = static_cast<int>(delayInFractionalSamples);
+		const T fraction = static_cast<T>(delayInFractionalSamples - wholeDelay);
+		const Spans newer = getReadSpans(wholeDelay, numSamples);
+		const Spans older = getReadSpans(wholeDelay + 1, numSamples);
+
+		decodeRun(output, newer[0].data, newer[0].size);
+		decodeRun(output + newer[0].size, newer[1].data, newer[1].size);
+		juce::FloatVectorOperations::multiply(output, T(1) - fraction, numSamples);
+		decodeAddWithMultiply(output, older[0].data, fraction, older[0].size);
+		decodeAddWithMultiply(output + older[0].size, older[1].data, fraction, older[1].size);
+	}
+
+	void writeBlock(const T* input, int numSamples)
+	{
+		const Spans spans = getWriteSpans(numSamples);
+		encodeRun(spans[0].data, input, spans[0].size);
+		encodeRun(spans[1].data, input + spans[0].size, spans[1].size);
+		advanceWriteIndex(numSamples);
+	}
+
+	// True when no read of the span reaches a sample written within it, so the span can be read as one block
+	template <typename Interpolator>
+	bool canReadBlock(const double* delayInSamples, int numSamples)
+	{
+		return juce::FloatVectorOperations::findMinimum(delayInSamples, numSamples) >= static_cast<double>(numSamples - 1 + Interpolator::newestTap);
+	}
+
+	// Per-sample delays read as a block: taps are gathered first, then evaluated in a separate loop that vectorizes
+	// for the non-recursive kernels. Encoded storage is decoded up front, as runs, over the window the span reads
+	// when that is compact (a steady or modulated delay), so each sample is decoded once rather than once per tap.
+	template <typename Interpolator>
+	void readBlock(T* output, const double* delayInSamples, int numSamples)
+	{
+		const Stored* const data = buffer;
+
+		if constexpr (std::is_same_v<Stored, T>)
+		{
+			gatherAndEvaluate<Interpolator>(output, delayInSamples, numSamples, [data, this](unsigned int index) { return data[index & wrapMask]; });
+		}
+		else
+		{
+			// offsets from the write head of the oldest and newest taps any read of the span takes
+			const int longest = static_cast<int>(juce::FloatVectorOperations::findMaximum(delayInSamples, numSamples));
+			const int shortest = static_cast<int>(juce::FloatVectorOperations::findMinimum(delayInSamples, numSamples));
+			const int oldest = Interpolator::newestTap - Interpolator::numTaps - longest;
+			const int windowLength = numSamples - 1 + Interpolator::newestTap - shortest - oldest;
+
+			if (windowLength <= decodeWindowSize)
+			{
+				T window[decodeWindowSize];
+				const unsigned int windowStart = writeIndex + static_cast<unsigned int>(oldest);
+				const Spans spans = makeSpans(windowStart & wrapMask, windowLength);
+				decodeRun(window, spans[0].data, spans[0].size);
+				decodeRun(window + spans[0].size, spans[1].data, spans[1].size);
+
+				gatherAndEvaluate<Interpolator>(output, delayInSamples, numSamples, [&window, windowStart](unsigned int index) { return window[index - windowStart]; });
+			}
+			else
+			{
+				gatherAndEvaluate<Interpolator>(output, delayInSamples, numSamples, [data, this](unsigned int index) { return Codec::decode(data[index & wrapMask]); });
+			}
+		}
+
+		// the next span's reads carry on from just after this span's newest tap
+		const int lastDelay = static_cast<int>(delayInSamples[numSamples - 1]);
+		const unsigned int nextReadIndex = (writeIndex + static_cast<unsigned int>(numSamples) - static_cast<unsigned int>(lastDelay)) & wrapMask;
+		for (const Span& span : makeSpans(nextReadIndex, numSamples))
+			prefetchForRead(span.data, static_cast<size_t>(span.size) * sizeof(Stored));
+	}
+
+	// Writes input + feedback * delayed for the span and advances the write head
+	void writeBlock(const T* input, const T* delayed, T feedback, int numSamples)
+	{
+		const Spans spans = getWriteSpans(numSamples);
+		int offset = 0;
+
+		for (const Span& span : spans)
+		{
+			if constexpr (std::is_same_v<Stored, T>)
+			{
+				juce::FloatVectorOperations::copy(span.data, input + offset, span.size);
+				juce::FloatVectorOperations::addWithMultiply(span.data, delayed + offset, feedback, span.size);
+			}
+			else
+			{
+				constexpr int chunkSize = 64;
+				T mixed[chunkSize];
+				for (int start = 0; start < span.size; start += chunkSize)
+				{
+					const int count = juce::jmin(chunkSize, span.size - start);
+					juce::FloatVectorOperations::copy(mixed, input + offset + start, count);
+					juce::FloatVectorOperations::addWithMultiply(mixed, delayed + offset + start, feedback, count);
+					encodeRun(span.data + start, mixed, count);
+				}
+			}
+
+			offset += span.size;
+		}
+
+		advanceWriteIndex(numSamples);
+	}
+
+	// Span path: one interpolated read and one feedback write per sample, with the delay already in samples.
+	// processFeedback(index, sample) is applied to each delayed sample before it is output and written back.
+	template <typename Interpolator, typename FeedbackProcessor>
+	void process(const T* input, T* output, int numSamples, const double* delayInSamples, T feedback, FeedbackProcessor&& processFeedback)
+	{
+		Stored* const data = buffer;
+		unsigned int index = writeIndex;
+
+		for (int i = 0; i < numSamples; ++i)
+		{
+			const int wholeDelay = static_cast<int>(delayInSamples[i]);
+			const unsigned int readIndex = (index - 1 - static_cast<unsigned int>(wholeDelay)) & wrapMask;
+			const T fraction = static_cast<T>(delayInSamples[i] - wholeDelay);
+			T delayedSample = processFeedback(i, readTaps<Interpolator>(data, readIndex, fraction));
+			output[i] = delayedSample;
+			data[index] = Codec::encode(input[i] + feedback * delayedSample);
+			index = (index + 1) & wrapMask;
+		}
+
+		writeIndex = index;
+	}
 
 	void setInterpolate(bool b) { interpolate = b; }
 
   unsigned int getBufferLength() { return bufferLength; }
 
+	unsigned int getWriteIndex() const { return writeIndex; }
+
 private:
-	std::unique_ptr<T[]> buffer = nullptr;		///< smart pointer will auto-delete
+	Spans makeSpans(unsigned int startIndex, int numSamples)
+	{
+		const int untilWrap = static_cast<int>(bufferLength - startIndex);
+		const int firstSize = juce::jmin(numSamples, untilWrap);
+		return { Span { buffer + startIndex, firstSize }, Span { buffer, numSamples - firstSize } };
+	}
+
+	template <typename Interpolator>
+	T readTaps(const Stored* data, unsigned int readIndex, T fraction)
+	{
+		T taps[Interpolator::numTaps];
+		for (int tap = 0; tap < Interpolator::numTaps; ++tap)
+			taps[tap] = Codec::decode(data[(readIndex + static_cast<unsigned int>(Interpolator::newestTap - tap)) & wrapMask]);
+		return Interpolator::evaluate(taps, fraction, allpassState);
+	}
+
+	static constexpr int decodeWindowSize = 256;		///< longest stretch readBlock decodes up front
+
+	// The gather behind readBlock: tapAt(index) gives the sample at ring position index, which is not yet wrapped
+	template <typename Interpolator, typename TapSource>
+	void gatherAndEvaluate(T* output, const double* delayInSamples, int numSamples, TapSource&& tapAt)
+	{
+		constexpr int chunkSize = 64;
+		T taps[chunkSize][Interpolator::numTaps];
+		T fractions[chunkSize];
+
+		for (int start = 0; start < numSamples; start += chunkSize)
+		{
+			const int chunk = juce::jmin(chunkSize, numSamples - start);
+
+			for (int i = 0; i < chunk; ++i)
+			{
+				const double delay = delayInSamples[start + i];
+				const int wholeDelay = static_cast<int>(delay);
+				const unsigned int readIndex = writeIndex + static_cast<unsigned int>(start + i) - 1 - static_cast<unsigned int>(wholeDelay);
+				fractions[i] = static_cast<T>(delay - wholeDelay);
+				for (int tap = 0; tap < Interpolator::numTaps; ++tap)
+					taps[i][tap] = tapAt(readIndex + static_cast<unsigned int>(Interpolator::newestTap - tap));
+			}
+
+			T state = allpassState;
+			for (int i = 0; i < chunk; ++i)
+				output[start + i] = Interpolator::evaluate(taps[i], fractions[i], state);
+			allpassState = state;
+		}
+	}
+
+	//== BLOCK PACK / UNPACK (plain copies for float storage; half floats use the conversion instructions if built for)
+	static constexpr bool hasWideConversions = std::is_same_v<Codec, StorageCodec::Float16> && std::is_same_v<T, float>;
+
+	static void decodeRun(T* output, const Stored* stored, int numSamples)
+	{
+		if constexpr (std::is_same_v<Stored, T>)
+			memcpy(output, stored, static_cast<size_t>(numSamples) * sizeof(T));
+		else
+		{
+			int i = 0;
+			if constexpr (hasWideConversions)
+				i = Codec::decodeWide(output, stored, numSamples);
+			for (; i < numSamples; ++i)
+				output[i] = Codec::decode(stored[i]);
+		}
+	}
+
+	static void decodeAddWithMultiply(T* output, const Stored* stored, T multiplier, int numSamples)
+	{
+		if constexpr (std::is_same_v<Stored, T>)
+			juce::FloatVectorOperations::addWithMultiply(output, stored, multiplier, numSamples);
+		else
+		{
+			constexpr int chunkSize = 64;
+			T decoded[chunkSize];
+			for (int start = 0; start < numSamples; start += chunkSize)
+			{
+				const int count = juce::jmin(chunkSize, numSamples - start);
+				decodeRun(decoded, stored + start, count);
+				juce::FloatVectorOperations::addWithMultiply(output + start, decoded, multiplier, count);
+			}
+		}
+	}
+
+	static void encodeRun(Stored* stored, const T* input, int numSamples)
+	{
+		if constexpr (std::is_same_v<Stored, T>)
+			memcpy(stored, input, static_cast<size_t>(numSamples) * sizeof(T));
+		else
+		{
+			int i = 0;
+			if constexpr (hasWideConversions)
+				i = Codec::encodeWide(stored, input, numSamples);
+			for (; i < numSamples; ++i)
+				stored[i] = Codec::encode(input[i]);
+		}
+	}
+
+	std::unique_ptr<Stored[]> ownedBuffer = nullptr;	///< smart pointer will auto-delete
+	Stored* buffer = nullptr;					///< ownedBuffer, or memory owned elsewhere
 	unsigned int writeIndex = 0;				///> write index
 	unsigned int bufferLength = 1024;			///< must be nearest power of 2
 	unsigned int wrapMask = bufferLength - 1;	///< must be (bufferLength - 1)
 	bool interpolate = true;					///< interpolation (default is ON)
+	T allpassState = 0;							///< previous output of the Thiran read head
+};
+
+//==============================================================================
+
+// Ring buffer for very long delays. It keeps CircularBuffer's power-of-two addressing, but the memory behind it is
+// split into fixed-size pages that only exist where a read head can reach: as the write head enters a page, the
+// page that fell out of reach is recycled into it, and pages beyond a shrinking reach are handed back. Pages come
+// from and go to the message thread through lock-free queues (providePages), so the audio thread never allocates
+// or frees, and memory follows the delay time actually in use rather than the longest one allowed.
+template <typename T>
+class PagedCircularBuffer
+{
+public:
+	static constexpr int pageShift = 13;
+	static constexpr unsigned int pageSize = 1u << pageShift;		// samples per page
+	static constexpr unsigned int pageMask = pageSize - 1;
+	static constexpr int sparePages = 8;							// fresh pages kept ready for a growing reach
+
+	PagedCircularBuffer() {}
+	~PagedCircularBuffer() { releaseBuffer(); }
+
+	// Reserves the address space (a page table) for delays up to _bufferLength samples; pages arrive later
+	void createCircularBuffer(unsigned int _bufferLength)
+	{
+		releaseBuffer();
+		bufferLength = static_cast<unsigned int>(juce::nextPowerOfTwo(static_cast<int>(juce::jmax(_bufferLength, 2 * pageSize))));
+		wrapMask = bufferLength - 1;
+		pages.assign(bufferLength >> pageShift, nullptr);
+		pageIndexMask = static_cast<unsigned int>(pages.size()) - 1;
+		writeIndex = 0;
+		allpassState = 0;
+		oldestPage = 0;
+		numLivePages = 0;
+		pagesInReach = 1;
+		providePages();
+	}
+
+	void releaseBuffer()
+	{
+		for (auto& page : pages)
+		{
+			delete[] page;
+			page = nullptr;
+		}
+
+		while (T* page = freePages.pop()) delete[] page;
+		while (T* page = retiredPages.pop()) delete[] page;
+		numLivePages = 0;
+	}
+
+	// Message thread: frees what the audio thread handed back and tops up the spare pages
+	void providePages()
+	{
+		while (T* page = retiredPages.pop())
+			delete[] page;
+
+		while (freePages.size() < sparePages)
+			if (!freePages.push(new T[pageSize]()))
+				break;
+	}
+
+	// Audio thread: the longest delay (in samples) the next reads may use. Pages beyond it are handed back.
+	void setReach(double delayInSamples)
+	{
+		const unsigned int reach = static_cast<unsigned int>(juce::jmax(0.0, delayInSamples)) + 4;	// interpolation neighbours
+		pagesInReach = juce::jmin(pageIndexMask, (reach + pageMask) / pageSize + 1);
+
+		while (numLivePages > pagesInReach)
+		{
+			T* const page = pages[oldestPage];
+			if (page != nullptr && !retiredPages.push(page))
+				break;	// queue full; the rest go on a later call
+			dropOldestPage();
+		}
+	}
+
+	void writeBuffer(T input)
+	{
+		if ((writeIndex & pageMask) == 0)
+			enterPage();
+
+		if (T* const page = pages[writeIndex >> pageShift])
+			page[writeIndex & pageMask] = input;
+
+		writeIndex = (writeIndex + 1) & wrapMask;
+	}
+
+	T readBuffer(int delayInSamples)
+	{
+		return read(writeIndex - 1 - static_cast<unsigned int>(delayInSamples));
+	}
+
+	template <typename Interpolator = Interpolation::Linear>
+	T readBuffer(double delayInFractionalSamples)
+	{
+		if (!interpolate) return readBuffer((int)delayInFractionalSamples);
+		const int wholeDelay = static_cast<int>(delayInFractionalSamples);
+		return readTaps<Interpolator>(writeIndex - 1 - static_cast<unsigned int>(wholeDelay), static_cast<T>(delayInFractionalSamples - wholeDelay));
+	}
+
+	//==============================================================================
+
+	template <typename Interpolator>
+	bool canReadBlock(const double* delayInSamples, int numSamples)
+	{
+		return juce::FloatVectorOperations::findMinimum(delayInSamples, numSamples) >= static_cast<double>(numSamples - 1 + Interpolator::newestTap);
+	}
+
+	template <typename Interpolator>
+	void readBlock(T* output, const double* delayInSamples, int numSamples)
+	{
+		T state = allpassState;
+
+		for (int i = 0; i < numSamples; ++i)
+		{
+			const int wholeDelay = static_cast<int>(delayInSamples[i]);
+			const unsigned int readIndex = writeIndex + static_cast<unsigned int>(i) - 1 - static_cast<unsigned int>(wholeDelay);
+			T taps[Interpolator::numTaps];
+			for (int tap = 0; tap < Interpolator::numTaps; ++tap)
+				taps[tap] = read(readIndex + static_cast<unsigned int>(Interpolator::newestTap - tap));
+			output[i] = Interpolator::evaluate(taps, static_cast<T>(delayInSamples[i] - wholeDelay), state);
+		}
+
+		allpassState = state;
+	}
+
+	void writeBlock(const T* input, const T* delayed, T feedback, int numSamples)
+	{
+		for (int i = 0; i < numSamples; ++i)
+			writeBuffer(input[i] + feedback * delayed[i]);
+	}
+
+	template <typename Interpolator, typename FeedbackProcessor>
+	void process(const T* input, T* output, int numSamples, const double* delayInSamples, T feedback, FeedbackProcessor&& processFeedback)
+	{
+		for (int i = 0; i < numSamples; ++i)
+		{
+			const int wholeDelay = static_cast<int>(delayInSamples[i]);
+			const T fraction = static_cast<T>(delayInSamples[i] - wholeDelay);
+			T delayedSample = processFeedback(i, readTaps<Interpolator>(writeIndex - 1 - static_cast<unsigned int>(wholeDelay), fraction));
+			output[i] = delayedSample;
+			writeBuffer(input[i] + feedback * delayedSample);
+		}
+	}
+
+	void setInterpolate(bool b) { interpolate = b; }
+
+	unsigned int getBufferLength() { return bufferLength; }
+
+	// Pages currently held by the write and read heads (spares excluded)
+	int getNumLivePages() const { return static_cast<int>(numLivePages); }
+
+private:
+	// Single-producer, single-consumer hand-off of pages between the audio and message threads
+	struct PageQueue
+	{
+		static constexpr int capacity = 256;
+
+		bool push(T* page)
+		{
+			int start1, size1, start2, size2;
+			fifo.prepareToWrite(1, start1, size1, start2, size2);
+			if (size1 == 0) return false;
+			slots[static_cast<size_t>(start1)] = page;
+			fifo.finishedWrite(1);
+			return true;
+		}
+
+		T* pop()
+		{
+			int start1, size1, start2, size2;
+			fifo.prepareToRead(1, start1, size1, start2, size2);
+			if (size1 == 0) return nullptr;
+			T* const page = slots[static_cast<size_t>(start1)];
+			fifo.finishedRead(1);
+			return page;
+		}
+
+		int size() const { return fifo.getNumReady(); }
+
+		juce::AbstractFifo fifo { capacity };
+		std::array<T*, capacity> slots {};
+	};
+
+	// Unallocated pages read as silence: history from before the reach grew was never kept
+	T read(unsigned int index) const
+	{
+		const T* const page = pages[(index & wrapMask) >> pageShift];
+		return page != nullptr ? page[index & pageMask] : T(0);
+	}
+
+	template <typename Interpolator>
+	T readTaps(unsigned int readIndex, T fraction)
+	{
+		T taps[Interpolator::numTaps];
+		for (int tap = 0; tap < Interpolator::numTaps; ++tap)
+			taps[tap] = read(readIndex + static_cast<unsigned int>(Interpolator::newestTap - tap));
+		return Interpolator::evaluate(taps, fraction, allpassState);
+	}
+
+	// The write head starts a page: reuse the oldest one if it just fell out of reach, else take a spare.
+	// With neither, the page stays unallocated and this stretch of history is dropped.
+	void enterPage()
+	{
+		T* page = nullptr;
+		if (numLivePages >= pagesInReach)
+			page = dropOldestPage();
+		if (page == nullptr)
+			page = freePages.pop();
+
+		pages[writeIndex >> pageShift] = page;
+		++numLivePages;
+	}
+
+	T* dropOldestPage()
+	{
+		T* const page = pages[oldestPage];
+		pages[oldestPage] = nullptr;
+		oldestPage = (oldestPage + 1) & pageIndexMask;
+		--numLivePages;
+		return page;
+	}
+
+	std::vector<T*> pages;						///< page table over the whole ring; null where nothing is kept
+	PageQueue freePages, retiredPages;			///< message thread -> audio thread, audio thread -> message thread
+	unsigned int writeIndex = 0;
+	unsigned int bufferLength = 2 * pageSize;	///< power of two, a whole number of pages
+	unsigned int wrapMask = bufferLength - 1;
+	unsigned int pageIndexMask = 1;
+	unsigned int oldestPage = 0;				///< live pages run from here up to the write head's page
+	unsigned int numLivePages = 0;
+	unsigned int pagesInReach = 1;
+	bool interpolate = true;
+	T allpassState = 0;
+};
+
+//==============================================================================
+
+// File-backed delay memory for looper-length delays (Linux; elsewhere allocate() fails and the heap is used).
+// The ring lives in an unlinked temp file mapped shared, so the kernel can write cold stretches back to disk instead
+// of holding every instance's minutes of audio in RAM. A background thread keeps what the heads touch next resident:
+// it asks for read-ahead on the oldest reachable stretch, re-touches every page the read heads can reach and dirties
+// the pages just ahead of the write head, so the audio thread finds its pages mapped and writable.
+class MappedRingMemory : private juce::Thread
+{
+public:
+	static constexpr size_t margin = 1 << 16;			// samples kept ready beyond both heads; a gliding delay moves the read head
+	static constexpr int prefaultInterval = 10;			// ms between passes
+
+	MappedRingMemory() : juce::Thread("Delay memory prefault") {}
+	~MappedRingMemory() override { release(); }
+
+	// Maps numSamples (a power of two) floats that read as zeros; nullptr when mapping isn't available.
+	// Prefaulting waits for startPrefaulting, once the owner has placed its buffer on the memory.
+	float* allocate(size_t numSamples)
+	{
+		jassert(juce::isPowerOfTwo(numSamples) && numSamples > 2 * margin);
+		release();
+
+	   #if JUCE_LINUX
+		char path[] = "/var/tmp/delay-ring-XXXXXX";
+		const int fd = mkstemp(path);
+		if (fd < 0)
+			return nullptr;
+
+		unlink(path);
+		const size_t numBytes = numSamples * sizeof(float);
+		void* const memory = ftruncate(fd, static_cast<off_t>(numBytes)) == 0 ? mmap(nullptr, numBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+																			   : MAP_FAILED;
+		close(fd);
+		if (memory == MAP_FAILED)
+			return nullptr;
+
+		samples = static_cast<float*>(memory);
+		numMappedSamples = numSamples;
+		samplesPerPage = static_cast<size_t>(sysconf(_SC_PAGESIZE)) / sizeof(float);
+		writeHead = 0;
+		reach = 0;
+		return samples;
+	   #else
+		juce::ignoreUnused(numSamples);
+		return nullptr;
+	   #endif
+	}
+
+	void startPrefaulting()
+	{
+		if (samples != nullptr)
+			startThread();
+	}
+
+	void release()
+	{
+		stopThread(1000);
+
+	   #if JUCE_LINUX
+		if (samples != nullptr)
+			munmap(samples, numMappedSamples * sizeof(float));
+	   #endif
+
+		samples = nullptr;
+		numMappedSamples = 0;
+	}
+
+	// Audio thread: the write index and how far behind it the reads may go, both in samples
+	void setHeads(unsigned int writeIndex, unsigned int longestDelay)
+	{
+		writeHead.store(writeIndex, std::memory_order_relaxed);
+		reach.store(longestDelay, std::memory_order_relaxed);
+	}
+
+private:
+	void run() override
+	{
+	   #if JUCE_LINUX
+		const size_t wrapMask = numMappedSamples - 1;
+
+		while (!threadShouldExit())
+		{
+			const size_t write = writeHead.load(std::memory_order_relaxed);
+			const size_t behind = juce::jmin(static_cast<size_t>(reach.load(std::memory_order_relaxed)) + margin, wrapMask - margin);
+			const size_t oldest = (write - behind) & wrapMask;
+
+			adviseWillNeed(oldest, margin);
+
+			for (size_t offset = 0; offset <= behind; offset += samplesPerPage)
+				static_cast<void>(*static_cast<volatile const float*>(samples + ((oldest + offset) & wrapMask)));
+
+			// or-ing in zero dirties the page without changing what the audio thread may be writing next to it
+			for (size_t offset = samplesPerPage; offset < margin; offset += samplesPerPage)
+				__atomic_fetch_or(reinterpret_cast<uint32_t*>(samples + ((write + offset) & wrapMask)), 0u, __ATOMIC_RELAXED);
+
+			wait(prefaultInterval);
+		}
+	   #endif
+	}
+
+   #if JUCE_LINUX
+	void adviseWillNeed(size_t start, size_t numSamples)
+	{
+		const size_t pageMask = samplesPerPage - 1;
+		const size_t first = start & ~pageMask;
+		const size_t untilWrap = numMappedSamples - first;
+		madvise(samples + first, juce::jmin(numSamples + (start - first), untilWrap) * sizeof(float), MADV_WILLNEED);
+		if (numSamples + (start - first) > untilWrap)
+			madvise(samples, (numSamples + (start - first) - untilWrap) * sizeof(float), MADV_WILLNEED);
+	}
+   #endif
+
+	float* samples = nullptr;
+	size_t numMappedSamples = 0;
+	size_t samplesPerPage = 1024;
+	std::atomic<unsigned int> writeHead { 0 }, reach { 0 };
 };
 
 //==============================================================================
@@ -70,18 +916,21 @@ private:
 class DelayLine
 {
 public:
+	DelayLine() = default;
+
 	explicit DelayLine(double sampleRate)
-	: currentSampleRate(sampleRate), 
-	coeff(1.0f - static_cast<float>(std::exp(-1.0f / (0.1f * sampleRate)))) {}
+	: coeff(1.0f - static_cast<float>(std::exp(-1.0f / (0.1f * sampleRate)))),
+	currentSampleRate(sampleRate),
+	samplesPerMs(sampleRate / 1000.0) {}
 
 	//==============================================================================
 
-	float getCurrentDelayTime()
+	double getCurrentDelayTime()
 	{
 		return delayTime;
 	}
 
-	void updateDelayTime(float newDelayTime)
+	void updateDelayTime(double newDelayTime)
 	{
 		delayTime = newDelayTime;
 	}
@@ -89,6 +938,7 @@ public:
 	void setSampleRate(double newSampleRate)
 	{
 		currentSampleRate = newSampleRate;
+		samplesPerMs = newSampleRate / 1000.0;
 		coeff = 1.0f - static_cast<float>(std::exp(-1.0f / (0.1f * newSampleRate)));
 	}
 
@@ -99,12 +949,12 @@ public:
 		smoothedDelayTime.reset(currentSampleRate, factor);
 	}
 
-	float getSmoothedCurrent()
+	double getSmoothedCurrent()
 	{
 		return smoothedDelayTime.getCurrentValue();
 	}
 
-	float getSmoothedNext()
+	double getSmoothedNext()
 	{
 		return smoothedDelayTime.getNextValue();
 	}
@@ -116,11 +966,25 @@ public:
 		return delayedSample;
 	}
 
-	void setNewTarget(float newDelayTime)
+	void setNewTarget(double newDelayTime)
 	{
 		smoothedDelayTime.setTargetValue(newDelayTime);
 	}
 
+	// Moves the glide on by numSamples towards newDelayTime, for spans that are not processed
+	void skipGlide(double newDelayTime, int numSamples)
+	{
+		smoothedDelayTime.setTargetValue(newDelayTime);
+		delayTime = smoothedDelayTime.skip(numSamples);
+	}
+
+	// Puts the delay time straight at newDelayTime (ms), with no glide from where it was
+	void holdDelayTime(double newDelayTime)
+	{
+		smoothedDelayTime.setCurrentAndTargetValue(newDelayTime);
+		delayTime = newDelayTime;
+	}
+
 	//==============================================================================
 
 	float applyOnePoleFilter(float current, float next, float coefficient)
@@ -128,71 +992,435 @@ public:
 		return next + ((next - current) * coefficient);
 	}
 
-	float applyChorus(int sample, float currentMixValue, float delayedSample, SmoothedValue<float, ValueSmoothingTypes::Linear>& delayTimeSmooth, float newDelayTime)
+	//==============================================================================
+
+	// Band-limited storage: the feedback signal is decimated by 2 or 4 through half-band stages before it is
+	// stored, and read back with cubic interpolation at the reduced rate. Everything read goes through the 7 kHz
+	// general low-pass before it is heard, so this mostly trades memory and cache traffic for a little filtering.
+	// The reduced rate is kept at 22.05 kHz or above so that low-pass band survives. Call before makeBuffer.
+	void setStorageDecimation(int factor)
 	{
-		chorusModulation = chorusDepth * std::sin(2.0f * static_cast<float>(juce::MathConstants<float>::pi * chorusRate * sample / currentSampleRate + chorusPhase));
-		chorusPhase += 2.0f * static_cast<float>(juce::MathConstants<float>::pi * chorusRate / currentSampleRate);
-		if (chorusPhase > 2.0f * static_cast<float>(juce::MathConstants<float>::pi))
+		storageDecimation = 1;
+		numStorageStages = 0;
+		while (storageDecimation < factor && numStorageStages < maxStorageStages && currentSampleRate / (storageDecimation * 2) >= 22050.0)
 		{
-			chorusPhase -= static_cast<float>(2.0 * juce::MathConstants<float>::pi);
+			storageDecimation *= 2;
+			++numStorageStages;
 		}
 
-		if (newDelayTime != delayTimeSmooth.getCurrentValue() && newDelayTime != 0.f) 
-		{
-			delayTimeSmooth.setTargetValue(newDelayTime + chorusModulation);
-		} 
-		else
+		for (auto& decimator : storageDecimators)
+			decimator.reset();
+
+		storageLatency = static_cast<double>(HalfBand::centre * (storageDecimation - 1));
+		samplesSinceStore = 0;
+	}
+
+	// Sample format of the delay memory; 16-bit formats halve its footprint and bandwidth. Call before makeBuffer.
+	void setStorageFormat(StorageCodec::Format format)
+	{
+		storageFormat = format;
+	}
+
+	// Where the delay memory comes from. Long delays use paged memory, where only the pages the delay actually reaches
+	// are held and the message thread has to keep them coming through providePages, or a mapped temp file, which falls
+	// back to the heap where mapping isn't available. Both are float32; the storage format is ignored. Call before makeBuffer.
+	enum class Memory { heap, paged, mapped };
+
+	void setMemory(Memory newMemory)
+	{
+		memory = newMemory;
+	}
+
+	// Message thread, periodically while paged memory is in use
+	void providePages()
+	{
+		if (memory == Memory::paged)
+			pagedBuff.providePages();
+	}
+
+	// Calls fn with the buffer for the current storage format
+	template <typename Fn>
+	decltype(auto) withBuffer(Fn&& fn)
+	{
+		if (memory == Memory::paged)
+			return fn(pagedBuff);
+		if (memory == Memory::mapped)
+			return fn(circBuff);
+
+		switch (storageFormat)
 		{
-			delayTimeSmooth.setTargetValue(newDelayTime);
+			case StorageCodec::Format::float16:  return fn(halfBuff);
+			case StorageCodec::Format::bfloat16: return fn(bfloatBuff);
+			case StorageCodec::Format::int16:    return fn(int16Buff);
+			case StorageCodec::Format::float32:
+			default:                             return fn(circBuff);
 		}
+	}
 
-		delayedSample = applyOnePoleFilter(delayedSample, delayTimeSmooth.getNextValue(), coeff);
+	// Arena bytes makeBuffer takes for maxDelayTime (ms); only heap memory comes from the arena
+	size_t getArenaBytes(float maxDelayTime)
+	{
+		if (memory != Memory::heap)
+			return 0;
+
+		const unsigned int length = getPowerOfTwoLength(maxDelayTime);
+		return withBuffer([length](auto& buffer) { return getArenaBytes(buffer, length); });
+	}
 
-		if (newDelayTime != 0.f && currentMixValue != 0.f)
+	// Sizes the buffer for the longest delay (ms) the caller will read, plus the interpolation neighbours.
+	// Only the buffer for the current storage format holds memory: heap memory is taken from the arena.
+	void makeBuffer(float maxDelayTime, DspArena& arena)
+	{
+		const unsigned int length = getPowerOfTwoLength(maxDelayTime);
+		maxDelayInSamples = static_cast<double>((length - 4) * static_cast<unsigned int>(storageDecimation));
+		releaseBuffer();
+
+		if (memory == Memory::heap)
 		{
-			delayedSample += chorusModulation * currentMixValue;
+			withBuffer([length, &arena](auto& buffer) { placeBuffer(buffer, length, arena); });
+			return;
 		}
 
-		return delayedSample;
-	};
+		if (memory == Memory::mapped)
+		{
+			if (float* const mapped = mappedMemory.allocate(length))
+			{
+				circBuff.useExternalBuffer(mapped, length, true);		// a fresh file reads as zeros
+				mappedMemory.startPrefaulting();
+				return;
+			}
+		}
+
+		withBuffer([length](auto& buffer) { buffer.createCircularBuffer(length); });
+	}
+
+	// Lets go of the buffer memory: pages and mappings are freed, arena memory is the caller's to release.
+	// makeBuffer must run again before processing.
+	void releaseBuffer()
+	{
+		circBuff.releaseBuffer();
+		halfBuff.releaseBuffer();
+		bfloatBuff.releaseBuffer();
+		int16Buff.releaseBuffer();
+		pagedBuff.releaseBuffer();
+		mappedMemory.release();
+	}
 
 	//==============================================================================
 
-	void makeBuffer()
+	// Delay memory carried across a rebuild: the newest stored samples, oldest first, at the rate they were stored
+	struct History
+	{
+		std::vector<float> samples;
+		double storageRate = 0.0;
+	};
+
+	// Copies out the newest historyTime (ms) of the current buffer; call before changing the rate or storage
+	History getHistory(float historyTime)
 	{
-		circBuff.createCircularBuffer(static_cast<unsigned int>(2 * currentSampleRate));		// double samplerate or limited to 1365ms @ 48k
-		circBuff.flushBuffer();
+		History history;
+		history.storageRate = currentSampleRate / storageDecimation;
+		const int numSamples = static_cast<int>(historyTime * samplesPerMs) / storageDecimation;
+		history.samples.resize(static_cast<size_t>(juce::jmax(0, numSamples)));
+
+		withBuffer([&history, numSamples](auto& buffer)
+		{
+			for (int i = 0; i < numSamples; ++i)
+				history.samples[static_cast<size_t>(i)] = buffer.readBuffer(numSamples - 1 - i);
+		});
+
+		return history;
+	}
+
+	// Writes a history into a freshly made buffer, resampled (cubic) to the current storage rate, so the echoes
+	// already in flight carry on at the same times. The buffer must be at least as long as the history.
+	void restoreHistory(const History& history)
+	{
+		const int numPrevious = static_cast<int>(history.samples.size());
+		if (numPrevious < Interpolation::CubicHermite::numTaps)
+			return;
+
+		const double ratio = history.storageRate * storageDecimation / currentSampleRate;	// previous samples per stored sample
+		const int numSamples = static_cast<int>(static_cast<double>(numPrevious - 1) / ratio) + 1;
+
+		if (memory == Memory::paged)
+			pagedBuff.setReach(static_cast<double>(numSamples));
+
+		withBuffer([&](auto& buffer)
+		{
+			for (int i = 0; i < numSamples; ++i)
+			{
+				if (memory == Memory::paged && (static_cast<unsigned int>(i) & PagedCircularBuffer<float>::pageMask) == 0)
+					pagedBuff.providePages();
+
+				buffer.writeBuffer(readHistory(history.samples, static_cast<double>(numSamples - 1 - i) * ratio));
+			}
+		});
 	}
 
 	float readBufferDelayedSample()
 	{
-		float delayedSample = circBuff.readBuffer(delayTime * currentSampleRate / 1000.0);
+		float delayedSample = withBuffer([this](auto& buffer) { return buffer.readBuffer(delayTime * samplesPerMs); });
 		return delayedSample;
 	}
 
 	void writeDelayBuffer(float readPointer, float feedback, float delayedSample)
 	{
-		circBuff.writeBuffer(readPointer + feedback * delayedSample);
+		withBuffer([&](auto& buffer) { buffer.writeBuffer(readPointer + feedback * delayedSample); });
+	}
+
+	// delayTimes holds one delay time (ms) per sample and is converted to samples in place, in double so the fraction
+	// survives at long delays (a float has none left past 2^23 samples). When every read of the
+	// span lands before its first write (the delay is at least the span long), the span runs as block stages: read
+	// it all, processFeedbackBlock(samples, numSamples) filters it in place, then write it all. Otherwise it runs
+	// per sample, with processFeedback(index, sample) applied to each delayed sample before it is written back.
+	template <typename FeedbackProcessor, typename BlockFeedbackProcessor>
+	void process(const float* in, float* out, int numSamples, double* delayTimes, float feedback, Interpolation::Quality quality,
+				 FeedbackProcessor&& processFeedback, BlockFeedbackProcessor&& processFeedbackBlock)
+	{
+		juce::FloatVectorOperations::multiply(delayTimes, samplesPerMs, numSamples);
+		updateReach(delayTimes, numSamples);
+
+		withBuffer([&](auto& buffer)
+		{
+			if (storageDecimation > 1)
+			{
+				processDecimated(buffer, in, out, numSamples, delayTimes, feedback, processFeedback, processFeedbackBlock);
+				return;
+			}
+
+			switch (quality)
+			{
+				case Interpolation::Quality::none:     processWith<Interpolation::None>(buffer, in, out, numSamples, delayTimes, feedback, processFeedback, processFeedbackBlock); break;
+				case Interpolation::Quality::cubic:    processWith<Interpolation::CubicHermite>(buffer, in, out, numSamples, delayTimes, feedback, processFeedback, processFeedbackBlock); break;
+				case Interpolation::Quality::lagrange: processWith<Interpolation::Lagrange>(buffer, in, out, numSamples, delayTimes, feedback, processFeedback, processFeedbackBlock); break;
+				case Interpolation::Quality::thiran:   processWith<Interpolation::Thiran>(buffer, in, out, numSamples, delayTimes, feedback, processFeedback, processFeedbackBlock); break;
+				case Interpolation::Quality::linear:
+				default:                               processWith<Interpolation::Linear>(buffer, in, out, numSamples, delayTimes, feedback, processFeedback, processFeedbackBlock); break;
+			}
+		});
 	}
 
-	void updateWriteIndex()
+	//== HANDOVER (moving the delay memory to another line, see Handover in Engine.h)
+
+	// Stores what another line at the same rate stored over a span (in + feedback * out), without reading, so this
+	// line builds up the same history. delayTimes (ms, converted to samples in place) are the reads this line will
+	// make once it takes over, which keep long-delay memory in reach.
+	void follow(const float* in, const float* out, float feedback, int numSamples, double* delayTimes)
 	{
-		writeIndex = (writeIndex + 1) % circBuff.getBufferLength();
+		juce::FloatVectorOperations::multiply(delayTimes, samplesPerMs, numSamples);
+		updateReach(delayTimes, numSamples);
+
+		withBuffer([&](auto& buffer)
+		{
+			for (int i = 0; i < numSamples; ++i)
+				storeSample(buffer, in[i] + feedback * out[i]);
+		});
+	}
+
+	// Runs this line and next in lock-step over a span: each reads at its own delays (ms, converted to samples in place),
+	// the reads are blended by fades (0 = this line, 1 = next), filtered once through processFeedback, and both store
+	// the same feedback signal. Per sample, so any delay works; it only runs for the few milliseconds of a crossfade.
+	template <typename FeedbackProcessor>
+	void processBlended(DelayLine& next, const float* in, float* out, int numSamples, double* delayTimes, double* nextDelayTimes,
+						float feedback, Interpolation::Quality quality, const float* fades, FeedbackProcessor&& processFeedback)
+	{
+		juce::FloatVectorOperations::multiply(delayTimes, samplesPerMs, numSamples);
+		juce::FloatVectorOperations::multiply(nextDelayTimes, next.samplesPerMs, numSamples);
+		updateReach(delayTimes, numSamples);
+		next.updateReach(nextDelayTimes, numSamples);
+
+		for (int i = 0; i < numSamples; ++i)
+		{
+			const float delayedSample = readDelayed(delayTimes[i], quality);
+			out[i] = processFeedback(i, delayedSample + fades[i] * (next.readDelayed(nextDelayTimes[i], quality) - delayedSample));
+
+			const float stored = in[i] + feedback * out[i];
+			storeDelayed(stored);
+			next.storeDelayed(stored);
+		}
+	}
+
+	// Carries the delay time glide over from the line this one takes over from
+	void takeTimingFrom(const DelayLine& other)
+	{
+		smoothedDelayTime = other.smoothedDelayTime;
+		delayTime = other.delayTime;
 	}
 
 	//==============================================================================
 
 private:
+	template <typename Interpolator, typename Buffer, typename FeedbackProcessor, typename BlockFeedbackProcessor>
+	void processWith(Buffer& buffer, const float* in, float* out, int numSamples, double* delayInSamples, float feedback,
+					 FeedbackProcessor& processFeedback, BlockFeedbackProcessor& processFeedbackBlock)
+	{
+		// shorter delays would put the kernel's newest tap on the write head, the oldest sample in the ring
+		if constexpr (Interpolator::newestTap > 0)
+			juce::FloatVectorOperations::max(delayInSamples, delayInSamples, static_cast<double>(Interpolator::newestTap), numSamples);
+
+		if (buffer.template canReadBlock<Interpolator>(delayInSamples, numSamples))
+		{
+			buffer.template readBlock<Interpolator>(out, delayInSamples, numSamples);
+			processFeedbackBlock(out, numSamples);
+			buffer.writeBlock(in, out, feedback, numSamples);
+		}
+		else
+		{
+			buffer.template process<Interpolator>(in, out, numSamples, delayInSamples, feedback, processFeedback);
+		}
+	}
+
+	// Tells long-delay memory how far back the reads of a span go (in samples)
+	void updateReach(const double* delayInSamples, int numSamples)
+	{
+		if (memory == Memory::heap)
+			return;
+
+		const double longest = juce::jmin(juce::FloatVectorOperations::findMaximum(delayInSamples, numSamples), maxDelayInSamples);
+		const double reach = longest / storageDecimation;
+		if (memory == Memory::paged)
+			pagedBuff.setReach(reach);
+		else
+			mappedMemory.setHeads(circBuff.getWriteIndex(), static_cast<unsigned int>(reach) + 4);
+	}
+
+	// One read as the span paths would make it, held within the memory
+	float readDelayed(double delayInSamples, Interpolation::Quality quality)
+	{
+		const double delay = juce::jmin(delayInSamples, maxDelayInSamples);
+
+		return withBuffer([&](auto& buffer)
+		{
+			if (storageDecimation > 1)
+				return buffer.template readBuffer<Interpolation::CubicHermite>(juce::jmax(getStoredDelay(delay, 0), static_cast<double>(Interpolation::CubicHermite::newestTap)));
+
+			switch (quality)
+			{
+				case Interpolation::Quality::none:     return buffer.template readBuffer<Interpolation::None>(delay);
+				case Interpolation::Quality::cubic:    return buffer.template readBuffer<Interpolation::CubicHermite>(juce::jmax(delay, static_cast<double>(Interpolation::CubicHermite::newestTap)));
+				case Interpolation::Quality::lagrange: return buffer.template readBuffer<Interpolation::Lagrange>(juce::jmax(delay, static_cast<double>(Interpolation::Lagrange::newestTap)));
+				case Interpolation::Quality::thiran:   return buffer.template readBuffer<Interpolation::Thiran>(juce::jmax(delay, static_cast<double>(Interpolation::Thiran::newestTap)));
+				case Interpolation::Quality::linear:
+				default:                               return buffer.template readBuffer<Interpolation::Linear>(delay);
+			}
+		});
+	}
+
+	void storeDelayed(float sample)
+	{
+		withBuffer([this, sample](auto& buffer) { storeSample(buffer, sample); });
+	}
+
+	// The history sample `age` previous samples before the newest, clamped at both ends
+	static float readHistory(const std::vector<float>& samples, double age)
+	{
+		using Interpolator = Interpolation::CubicHermite;
+		const int newest = static_cast<int>(samples.size()) - 1;
+		const int wholeAge = static_cast<int>(age);
+		float taps[Interpolator::numTaps];
+
+		for (int tap = 0; tap < Interpolator::numTaps; ++tap)
+			taps[tap] = samples[static_cast<size_t>(juce::jlimit(0, newest, newest - (wholeAge + tap - Interpolator::newestTap)))];
+
+		float state = 0.f;
+		return Interpolator::evaluate(taps, static_cast<float>(age - wholeAge), state);
+	}
+
+	unsigned int getPowerOfTwoLength(float maxDelayTime) const
+	{
+		const double longestDelay = maxDelayTime * samplesPerMs;
+		return static_cast<unsigned int>(juce::nextPowerOfTwo(static_cast<int>(std::ceil(longestDelay / storageDecimation)) + 4));
+	}
+
+	template <typename Buffer>
+	static size_t getArenaBytes(Buffer&, unsigned int length) { return DspArena::getBytesFor<typename Buffer::Stored>(length); }
+	static size_t getArenaBytes(PagedCircularBuffer<float>&, unsigned int) { return 0; }
+
+	template <typename Buffer>
+	static void placeBuffer(Buffer& buffer, unsigned int length, DspArena& arena) { buffer.useExternalBuffer(arena.allocate<typename Buffer::Stored>(length), length); }
+	static void placeBuffer(PagedCircularBuffer<float>&, unsigned int, DspArena&) { jassertfalse; }
+
+	// Reduced-rate delay (in stored samples) for a read `ahead` samples into the span, counted from the newest
+	// stored sample. What was stored lags the write by the decimators' latency and by the writes since it was stored.
+	double getStoredDelay(double delayInSamples, int ahead) const
+	{
+		return (delayInSamples - storageLatency - (samplesSinceStore + ahead)) / storageDecimation;
+	}
+
+	template <typename Buffer>
+	void storeSample(Buffer& buffer, float sample)
+	{
+		bool ready = true;
+		for (int stage = 0; ready && stage < numStorageStages; ++stage)
+			ready = storageDecimators[stage].process(sample, sample);
+
+		if (ready)
+		{
+			buffer.writeBuffer(sample);
+			samplesSinceStore = 0;
+		}
+		else
+		{
+			++samplesSinceStore;
+		}
+	}
+
+	template <typename Buffer, typename FeedbackProcessor, typename BlockFeedbackProcessor>
+	void processDecimated(Buffer& buffer, const float* in, float* out, int numSamples, const double* delayInSamples, float feedback,
+						  FeedbackProcessor& processFeedback, BlockFeedbackProcessor& processFeedbackBlock)
+	{
+		// the span can be read before any of it is stored when every read lands at least one stored sample back
+		double shortestStoredDelay = std::numeric_limits<double>::max();
+		for (int i = 0; i < numSamples; ++i)
+			shortestStoredDelay = juce::jmin(shortestStoredDelay, getStoredDelay(delayInSamples[i], i));
+
+		if (shortestStoredDelay >= static_cast<double>(Interpolation::CubicHermite::newestTap))
+		{
+			for (int i = 0; i < numSamples; ++i)
+				out[i] = buffer.template readBuffer<Interpolation::CubicHermite>(getStoredDelay(delayInSamples[i], i));
+
+			processFeedbackBlock(out, numSamples);
+
+			for (int i = 0; i < numSamples; ++i)
+				storeSample(buffer, in[i] + feedback * out[i]);
+		}
+		else
+		{
+			// delays shorter than the decimators' latency (about a millisecond) are held at the shortest readable one
+			for (int i = 0; i < numSamples; ++i)
+			{
+				const double storedDelay = juce::jmax(getStoredDelay(delayInSamples[i], 0), static_cast<double>(Interpolation::CubicHermite::newestTap));
+				out[i] = processFeedback(i, buffer.template readBuffer<Interpolation::CubicHermite>(storedDelay));
+				storeSample(buffer, in[i] + feedback * out[i]);
+			}
+		}
+	}
+
+	//==============================================================================
+
+	static constexpr int maxStorageStages = 2;
+
 	CircularBuffer<float> circBuff;
-	juce::LinearSmoothedValue<float> smoothedDelayTime;
-	float delayTime;
+	CircularBuffer<float, StorageCodec::Float16> halfBuff;
+	CircularBuffer<float, StorageCodec::BFloat16> bfloatBuff;
+	CircularBuffer<float, StorageCodec::Int16> int16Buff;
+	PagedCircularBuffer<float> pagedBuff;
+	MappedRingMemory mappedMemory;
+	Memory memory = Memory::heap;
+	StorageCodec::Format storageFormat = StorageCodec::Format::float32;
+	juce::LinearSmoothedValue<double> smoothedDelayTime;		// ms
+	double delayTime = 0.0;
+	double maxDelayInSamples = 0.0;				// host-rate reach of the buffer, set by makeBuffer
 
-	float coeff;
-	double currentSampleRate;
-	int writeIndex = 0;
+	float coeff = 0.f;
+	double currentSampleRate = 44100.0;
+	double samplesPerMs = 44.1;
 
-	float chorusRate = 0.45f; 
-	float chorusDepth = 0.75f;
-	float chorusPhase = 0.f;
-	float chorusModulation = 0.f;
+	//== BAND-LIMITED STORAGE
+	int storageDecimation = 1;
+	int numStorageStages = 0;
+	double storageLatency = 0.0;				// host-rate samples the decimators delay what they store
+	int samplesSinceStore = 0;
+	std::array<HalfBand::Decimator, maxStorageStages> storageDecimators;
 };
\ No newline at end of file
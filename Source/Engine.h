@@ -0,0 +1,320 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "Arena.h"
+#include "DelayLine.h"
+#include "ReverbLines.h"
+
+//==============================================================================
+
+// Engines hold the DSP state whose shape depends on a layout: the delay lines with their storage, and the reverb
+// lines. Each lives in an arena of its own. When the layout changes, prepareToPlay builds the new engine in place
+// (audio is stopped). While audio runs, the message thread notices the change, a worker thread builds and pre-warms
+// the next engine, and the audio thread adopts it with one atomic exchange. Once the audio thread has moved over
+// (see Handover), it hands the old engine back the same way, and the message thread frees it: RCU style, the
+// reader says when it is done. Nothing is allocated or freed on the audio thread. One engine is in flight at a time.
+// The message-side calls are serialised by a lock, since a timer callback can still be running when prepareToPlay or
+// releaseResources (on another thread) settle the builder; update starts nothing between settle and resume.
+template <typename Engine>
+class EngineBuilder : private juce::Thread
+{
+public:
+	using Layout = typename Engine::Layout;
+
+	EngineBuilder() : juce::Thread("DSP engine build") {}
+	~EngineBuilder() override { settle(nullptr); }
+
+	//== AUDIO STOPPED (prepareToPlay, releaseResources)
+
+	// Stops any build (it gives up between steps, and is waited for) and frees every engine but the one the audio
+	// thread was on (all of them for nullptr). No builds start until resume.
+	Engine* settle(Engine* inUse)
+	{
+		const juce::ScopedLock sl(lock);
+		building = false;
+		stopThread(-1);
+		delete built.exchange(nullptr);
+		published.store(nullptr);
+		retired.store(nullptr);
+
+		std::unique_ptr<Engine> kept;
+		if (inUse != nullptr && inUse == newest.get())
+			kept = std::move(newest);
+		else if (inUse != nullptr && inUse == older.get())
+			kept = std::move(older);
+
+		newest = std::move(kept);
+		older.reset();
+		return newest.get();
+	}
+
+	// settle(nullptr) for deactivation: the newest engine's arena, the layout reactivating asks for again, goes to the
+	// pool (see DspArena::release) before the engines are freed
+	void release()
+	{
+		const juce::ScopedLock sl(lock);
+		building = false;
+		stopThread(-1);
+
+		if (newest != nullptr)
+			newest->arena.release();
+
+		settle(nullptr);
+	}
+
+	// Builds an engine for layout right away. carryOver(previous, engine) can move state across; previous
+	// (nullptr when there was none) is freed after it.
+	template <typename CarryOver>
+	Engine* rebuild(const Layout& layout, CarryOver&& carryOver)
+	{
+		const juce::ScopedLock sl(lock);
+		auto engine = std::make_unique<Engine>(layout);
+		engine->build([] { return false; });
+		carryOver(newest.get(), *engine);
+		newest = std::move(engine);
+		return newest.get();
+	}
+
+	// Lets update build again, once the engine the audio thread starts on is in place
+	void resume()
+	{
+		const juce::ScopedLock sl(lock);
+		building = true;
+	}
+
+	//== MESSAGE THREAD (on a timer)
+
+	// Frees the engine the audio thread handed back, publishes a finished build and starts the next build when
+	// wanted differs from the newest engine. With no engine yet, one is only built when buildFirst is set.
+	void update(const Layout& wanted, bool buildFirst)
+	{
+		const juce::ScopedLock sl(lock);
+
+		if (! building)
+			return;
+
+		if (Engine* const done = retired.exchange(nullptr, std::memory_order_acquire))
+		{
+			jassert(done == older.get());
+			older.reset();
+		}
+
+		if (Engine* const next = built.exchange(nullptr, std::memory_order_acquire))
+		{
+			older = std::move(newest);
+			newest.reset(next);
+			published.store(next, std::memory_order_release);
+		}
+
+		if (isThreadRunning() || older != nullptr || published.load(std::memory_order_acquire) != nullptr)
+			return;
+
+		if (newest != nullptr ? newest->layout == wanted : ! buildFirst)
+			return;
+
+		buildLayout = wanted;
+		startThread();
+	}
+
+	// Calls fn for every engine the audio thread may be using, under the lock so settle cannot free one meanwhile.
+	// Between settle and resume prepareToPlay owns the engines, and fn is not called.
+	template <typename Fn>
+	void forEachEngine(Fn&& fn)
+	{
+		const juce::ScopedLock sl(lock);
+
+		if (! building)
+			return;
+
+		if (newest != nullptr) fn(*newest);
+		if (older != nullptr) fn(*older);
+	}
+
+	size_t getUsedBytes() const
+	{
+		const juce::ScopedLock sl(lock);
+		return (newest != nullptr ? newest->arena.getUsedBytes() : 0) + (older != nullptr ? older->arena.getUsedBytes() : 0);
+	}
+
+	//== AUDIO THREAD
+
+	// The next engine once it is built, else nullptr; each engine is returned once
+	Engine* adopt() { return published.exchange(nullptr, std::memory_order_acquire); }
+
+	// Hands back an engine the audio thread no longer touches
+	void retire(Engine* engine) { retired.store(engine, std::memory_order_release); }
+
+private:
+	void run() override
+	{
+		auto engine = std::make_unique<Engine>(buildLayout);
+
+		if (engine->build([this] { return threadShouldExit(); }))
+			built.store(engine.release(), std::memory_order_release);
+	}
+
+	juce::CriticalSection lock;						// guards everything below but the atomics
+	bool building = false;							// between resume and settle
+	std::unique_ptr<Engine> newest, older;			// older is the one the audio thread is leaving
+	std::atomic<Engine*> built { nullptr }, published { nullptr }, retired { nullptr };
+	Layout buildLayout {};
+};
+
+//==============================================================================
+
+// Audio-thread progress of a move to the next engine. The next engine first shadows the current one: it is fed
+// what the current one is fed until its memory holds the history the current one is reading. Then the two are
+// crossfaded over a few milliseconds, after which the current engine is retired.
+class Handover
+{
+public:
+	static constexpr float crossfadeTime = 5.f;			// ms
+
+	void start(int shadowSamples, double sampleRate)
+	{
+		shadowRemaining = shadowSamples;
+		fadeLength = juce::jmax(1, static_cast<int>(crossfadeTime * sampleRate / 1000.0));
+		fadePosition = 0;
+	}
+
+	bool isShadowing() const { return shadowRemaining > 0; }
+
+	// Gains of the next engine for the next numSamples of the crossfade, rising to 1
+	void getFades(float* fades, int numSamples) const
+	{
+		for (int i = 0; i < numSamples; ++i)
+			fades[i] = juce::jmin(1.f, static_cast<float>(fadePosition + i + 1) / static_cast<float>(fadeLength));
+	}
+
+	// Moves on by a span; true once the crossfade is complete
+	bool advance(int numSamples)
+	{
+		if (isShadowing())
+		{
+			shadowRemaining -= numSamples;
+			return false;
+		}
+
+		fadePosition += numSamples;
+		return fadePosition >= fadeLength;
+	}
+
+private:
+	int shadowRemaining = 0;
+	int fadePosition = 0;
+	int fadeLength = 1;
+};
+
+//==============================================================================
+
+// The delay lines and the memory they store into
+struct DelayEngine
+{
+	static constexpr float glideTime = 0.7f;			// s, delay time changes ramp over this
+
+	struct Layout
+	{
+		double sampleRate = 0.0;
+		bool longDelay = false;							// "Delay Left" / "Delay Right" scaled to the long range
+		int delayDecimation = 1;
+		int delayFormat = 0;
+		DelayLine::Memory delayMemory = DelayLine::Memory::heap;
+		float bufferDelayTime = 0.f;					// ms the delay buffers hold
+
+		bool operator==(const Layout& other) const
+		{
+			return sampleRate == other.sampleRate && longDelay == other.longDelay && delayDecimation == other.delayDecimation
+				&& delayFormat == other.delayFormat && delayMemory == other.delayMemory && bufferDelayTime == other.bufferDelayTime;
+		}
+	};
+
+	explicit DelayEngine(const Layout& newLayout) : layout(newLayout)
+	{
+		for (auto& delayLine : delayLines)
+		{
+			delayLine.setSampleRate(layout.sampleRate);
+			delayLine.setStorageDecimation(layout.delayDecimation);
+			delayLine.setStorageFormat(static_cast<StorageCodec::Format>(layout.delayFormat));
+			delayLine.setMemory(layout.delayMemory);
+			delayLine.resetSmoothedValue(glideTime);
+		}
+	}
+
+	// Lays out the memory; false when shouldStop() asked to give up between steps
+	template <typename ShouldStop>
+	bool build(ShouldStop&& shouldStop)
+	{
+		arena.reset(delayLines[0].getArenaBytes(layout.bufferDelayTime) + delayLines[1].getArenaBytes(layout.bufferDelayTime));
+
+		for (auto& delayLine : delayLines)
+		{
+			if (shouldStop())
+				return false;
+
+			delayLine.makeBuffer(layout.bufferDelayTime, arena);
+		}
+
+		return true;
+	}
+
+	const Layout layout;
+	DspArena arena;
+	std::array<DelayLine, 2> delayLines;		// [left, right]
+
+	JUCE_DECLARE_NON_COPYABLE(DelayEngine)
+};
+
+//==============================================================================
+
+// The reverb lines, built the first time "Reverb" is on, so instances that never use it never hold their memory
+struct ReverbEngine
+{
+	static constexpr double shadowTime = 1.0;			// s; the lines glide in over 0.7 s and ring for a while after
+
+	struct Layout
+	{
+		double sampleRate = 0.0;
+		int rateDivisor = 1;
+
+		bool operator==(const Layout& other) const { return sampleRate == other.sampleRate && rateDivisor == other.rateDivisor; }
+	};
+
+	explicit ReverbEngine(const Layout& newLayout) : layout(newLayout) {}
+
+	// Lays out the lines; false when shouldStop() asked to give up between steps
+	template <typename ShouldStop>
+	bool build(ShouldStop&& shouldStop)
+	{
+		arena.reset(ReverbLines::getArenaBytes(layout.sampleRate, layout.rateDivisor));
+
+		if (shouldStop())
+			return false;
+
+		lines = arena.create<ReverbLines>(layout.sampleRate, layout.rateDivisor, arena);
+		return true;
+	}
+
+	//== CLEARING (a memset of megabytes, so the timer does it once the audio thread has set the lines aside)
+	enum class LinesState { inUse, toClear, clear };
+
+	// Audio thread
+	bool isClear() const { return linesState.load(std::memory_order_acquire) == LinesState::clear; }
+	void setInUse(bool inUse) { linesState.store(inUse ? LinesState::inUse : LinesState::toClear, std::memory_order_release); }
+
+	// Timer
+	void clearIfSetAside()
+	{
+		if (linesState.load(std::memory_order_acquire) != LinesState::toClear)
+			return;
+
+		lines->clear();
+		linesState.store(LinesState::clear, std::memory_order_release);
+	}
+
+	const Layout layout;
+	DspArena arena;
+	ReverbLines* lines = nullptr;
+	std::atomic<LinesState> linesState { LinesState::clear };	// built clear
+
+	JUCE_DECLARE_NON_COPYABLE(ReverbEngine)
+};
@@ -2,35 +2,312 @@
 
 #include "PluginProcessor.h"
 
+// Value-type biquad (transposed direct form II). Coefficients are plain floats computed in place with the same
+// formulas as juce::dsp::IIR::Coefficients, so updating them never allocates or touches a reference count.
+struct Biquad
+{
+    struct Coefficients
+    {
+        float b0 = 1.f, b1 = 0.f, b2 = 0.f, a1 = 0.f, a2 = 0.f;
+
+        static Coefficients makeLowPass(double sampleRate, float frequency, float Q = juce::MathConstants<float>::sqrt2 * 0.5f)
+        {
+            const float n = 1.f / std::tan(juce::MathConstants<float>::pi * frequency / static_cast<float>(sampleRate));
+            const float nSquared = n * n;
+            const float invQ = 1.f / Q;
+            const float c1 = 1.f / (1.f + invQ * n + nSquared);
+            return { c1, c1 * 2.f, c1, c1 * 2.f * (1.f - nSquared), c1 * (1.f - invQ * n + nSquared) };
+        }
+
+        static Coefficients makeHighPass(double sampleRate, float frequency, float Q = juce::MathConstants<float>::sqrt2 * 0.5f)
+        {
+            const float n = std::tan(juce::MathConstants<float>::pi * frequency / static_cast<float>(sampleRate));
+            const float nSquared = n * n;
+            const float invQ = 1.f / Q;
+            const float c1 = 1.f / (1.f + invQ * n + nSquared);
+            return { c1, c1 * -2.f, c1, c1 * 2.f * (nSquared - 1.f), c1 * (1.f - invQ * n + nSquared) };
+        }
+
+        static Coefficients makeAllPass(double sampleRate, float frequency, float Q)
+        {
+            const float n = 1.f / std::tan(juce::MathConstants<float>::pi * frequency / static_cast<float>(sampleRate));
+            const float nSquared = n * n;
+            const float c1 = 1.f / (1.f + 1.f / Q * n + nSquared);
+            return { c1 * (1.f - n / Q + nSquared), c1 * 2.f * (1.f - nSquared), 1.f, c1 * 2.f * (1.f - nSquared), c1 * (1.f - n / Q + nSquared) };
+        }
+    };
+
+    struct State
+    {
+        float s1 = 0.f, s2 = 0.f;
+    };
+
+    static float processSample(const Coefficients& c, State& state, float input)
+    {
+        const float output = c.b0 * input + state.s1;
+        state.s1 = c.b1 * input - c.a1 * output + state.s2;
+        state.s2 = c.b2 * input - c.a2 * output;
+        return output;
+    }
+
+    // One span through the filter; coefficients and state are copied into locals so they stay in registers
+    static void processBlock(const Coefficients& coefficients, State& state, const float* input, float* output, int numSamples)
+    {
+        const Coefficients c = coefficients;
+        State s = state;
+
+        for (int i = 0; i < numSamples; ++i)
+            output[i] = processSample(c, s, input[i]);
+
+        state = s;
+    }
+};
+
+// Topology-preserving (trapezoidal) state-variable filter. One state yields low, band and high pass together, and
+// the cutoff can move every sample because the only cutoff-dependent terms are g = tan(pi * fc / fs) and one division.
+struct StateVariableFilter
+{
+    static constexpr float k = juce::MathConstants<float>::sqrt2;         // 1 / Q, Butterworth like the biquads
+
+    struct Coefficients
+    {
+        float g = 0.f, h = 1.f;
+
+        static Coefficients make(double sampleRate, float frequency)
+        {
+            const float g = fastTan(juce::MathConstants<float>::pi * juce::jmin(frequency, 0.49f * static_cast<float>(sampleRate)) / static_cast<float>(sampleRate));
+            return { g, 1.f / (1.f + g * (k + g)) };
+        }
+    };
+
+    struct State
+    {
+        float s1 = 0.f, s2 = 0.f;
+    };
+
+    struct Outputs
+    {
+        float lowPass, bandPass, highPass;
+    };
+
+    static Outputs processSample(const Coefficients& c, State& state, float input)
+    {
+        const float highPass = (input - (k + c.g) * state.s1 - state.s2) * c.h;
+        const float v1 = c.g * highPass;
+        const float bandPass = v1 + state.s1;
+        state.s1 = bandPass + v1;
+        const float v2 = c.g * bandPass;
+        const float lowPass = v2 + state.s2;
+        state.s2 = lowPass + v2;
+        return { lowPass, bandPass, highPass };
+    }
+
+    // [3/2] Pade approximant, within 0.1% of tan up to x = 1 (fc = 0.32 fs)
+    static float fastTan(float x)
+    {
+        const float x2 = x * x;
+        return x * (15.f - x2) / (15.f - 6.f * x2);
+    }
+};
+
+//==============================================================================
+
+// Linear-phase half-band low-pass for 2:1 rate changes. Apart from the centre tap (0.5) only every other tap is
+// non-zero, so both directions run in polyphase form: numSideTaps multiply pairs per low-rate sample.
+struct HalfBand
+{
+    static constexpr int numSideTaps = 8;
+    static constexpr int centre = 2 * numSideTaps - 1;      // group delay, in samples at the high rate
+
+    using SideTaps = std::array<float, numSideTaps>;
+
+    // Blackman-windowed sinc; sideTaps[j] sits 2j + 1 taps either side of the centre. Normalised for unity DC gain.
+    static SideTaps makeSideTaps()
+    {
+        SideTaps sideTaps;
+        const double pi = juce::MathConstants<double>::pi;
+        const double windowLength = 2.0 * (centre + 1);
+        double sum = 0.0;
+
+        for (int j = 0; j < numSideTaps; ++j)
+        {
+            const double offset = 2 * j + 1;
+            const double phase = (centre + offset + 1) / windowLength;
+            const double window = 0.42 - 0.5 * std::cos(2.0 * pi * phase) + 0.08 * std::cos(4.0 * pi * phase);
+            const double tap = ((j % 2 == 0) ? 1.0 : -1.0) / (pi * offset) * window;
+            sideTaps[j] = static_cast<float>(tap);
+            sum += tap;
+        }
+
+        for (auto& tap : sideTaps)
+            tap = static_cast<float>(tap * 0.25 / sum);
+
+        return sideTaps;
+    }
+
+    // High rate in, every second call produces a low-rate sample
+    class Decimator
+    {
+    public:
+        void reset()
+        {
+            history.fill(0.f);
+            writeIndex = 0;
+            phase = 0;
+        }
+
+        bool process(float input, float& output)
+        {
+            writeIndex = (writeIndex + 1) & historyMask;
+            history[writeIndex] = input;
+
+            if ((phase ^= 1) != 0)
+                return false;
+
+            const unsigned int centreIndex = writeIndex - centre;
+            output = 0.5f * history[centreIndex & historyMask];
+            for (int j = 0; j < numSideTaps; ++j)
+                output += sideTaps[j] * (history[(centreIndex + 2 * j + 1) & historyMask] + history[(centreIndex - 2 * j - 1) & historyMask]);
+
+            return true;
+        }
+
+    private:
+        static constexpr unsigned int historyMask = 31;     // holds the 4 * numSideTaps - 1 taps of the filter
+        const SideTaps sideTaps = makeSideTaps();
+        std::array<float, historyMask + 1> history {};
+        unsigned int writeIndex = 0;
+        int phase = 0;
+    };
+
+    // One low-rate sample in, two high-rate samples out
+    class Interpolator
+    {
+    public:
+        void reset()
+        {
+            history.fill(0.f);
+            writeIndex = 0;
+        }
+
+        void process(float input, float& first, float& second)
+        {
+            writeIndex = (writeIndex + 1) & historyMask;
+            history[writeIndex] = input;
+
+            const unsigned int newer = writeIndex - (numSideTaps - 1);
+            first = 0.f;
+            for (int j = 0; j < numSideTaps; ++j)
+                first += sideTaps[j] * (history[(newer + j) & historyMask] + history[(newer - 1 - j) & historyMask]);
+            first *= 2.f;
+            second = history[newer & historyMask];
+        }
+
+    private:
+        static constexpr unsigned int historyMask = 15;     // 2 * numSideTaps low-rate samples
+        const SideTaps sideTaps = makeSideTaps();
+        std::array<float, historyMask + 1> history {};
+        unsigned int writeIndex = 0;
+    };
+};
+
+//==============================================================================
+
+// Log-spaced cutoff -> coefficient table, built once per sample rate. A lookup costs a cheap log2 estimate and a
+// linear blend of the two neighbouring entries instead of tan/divisions per update.
+class CutoffTable
+{
+public:
+    static constexpr int tableSize = 256;
+
+    template <typename CoefficientMaker>
+    void build(float minFrequency, float maxFrequency, CoefficientMaker&& makeCoefficients)
+    {
+        minCutoff = minFrequency;
+        minOctave = std::log2(minFrequency);
+        octavesToIndex = static_cast<float>(tableSize - 1) / (std::log2(maxFrequency) - minOctave);
+
+        for (int i = 0; i < tableSize; ++i)
+            table[i] = makeCoefficients(minFrequency * std::exp2(static_cast<float>(i) / octavesToIndex));
+    }
+
+    Biquad::Coefficients lookup(float frequency) const
+    {
+        const float position = juce::jlimit(0.f, static_cast<float>(tableSize - 1), (fastLog2(juce::jmax(frequency, minCutoff)) - minOctave) * octavesToIndex);
+        const int index = juce::jmin(static_cast<int>(position), tableSize - 2);
+        const float fraction = position - static_cast<float>(index);
+        const Biquad::Coefficients& lower = table[index];
+        const Biquad::Coefficients& upper = table[index + 1];
+
+        return { lower.b0 + fraction * (upper.b0 - lower.b0),
+                 lower.b1 + fraction * (upper.b1 - lower.b1),
+                 lower.b2 + fraction * (upper.b2 - lower.b2),
+                 lower.a1 + fraction * (upper.a1 - lower.a1),
+                 lower.a2 + fraction * (upper.a2 - lower.a2) };
+    }
+
+private:
+    // exponent from frexp plus a quadratic fit of log2 over the mantissa (max error ~0.001 octave)
+    static float fastLog2(float x)
+    {
+        int exponent;
+        const float t = 2.f * std::frexp(x, &exponent) - 1.f;
+        return static_cast<float>(exponent - 1) + t + t * (1.f - t) * (0.42086f - 0.15639f * t);
+    }
+
+    std::array<Biquad::Coefficients, tableSize> table;
+    float minCutoff = 20.f;
+    float minOctave = 0.f;
+    float octavesToIndex = 1.f;
+};
+
+//==============================================================================
+
 class Filters {
 public:
+    static constexpr float minCutoff = 20.f;                // "Low Pass Freq" / "High Pass Freq" ranges
+    static constexpr float maxLowPassCutoff = 7000.f;
+    static constexpr float maxHighPassCutoff = 1000.f;
+
     float lastLowPassFreq;
     float lastHighPassFreq;
 
     Filters(double sampleRate) : currentSampleRate(sampleRate)
     {
+        buildCoefficientTables();
         setupFilters();
     }
 
+    void buildCoefficientTables()
+    {
+        lowPassTable.build(minCutoff, maxLowPassCutoff, [this](float frequency) { return Biquad::Coefficients::makeLowPass(currentSampleRate, frequency); });
+        highPassTable.build(minCutoff, maxHighPassCutoff, [this](float frequency) { return Biquad::Coefficients::makeHighPass(currentSampleRate, frequency); });
+    }
+
     void setupFilters()
     {
-        leftLowPass.reset(); 
-        rightLowPass.reset();
-        leftHighPass.reset(); 
-        rightHighPass.reset();
-        leftLowAll.reset();
-        rightLowAll.reset();
+        lowPassCoefficients = Biquad::Coefficients::makeLowPass(currentSampleRate, 2000);     //const double highSampleRate = 1e6; // 1mil hz
+        highPassCoefficients = Biquad::Coefficients::makeHighPass(currentSampleRate, 500);
+        lowAllCoefficients = Biquad::Coefficients::makeLowPass(currentSampleRate, 7000);
+
+        lowPass.fill({});
+        highPass.fill({});
+        lowAll.fill({});
+        lowPassSvf.fill({});
+        highPassSvf.fill({});
+    }
 
-        juce::dsp::IIR::Coefficients<float>::Ptr coefficientsLow = juce::dsp::IIR::Coefficients<float>::makeLowPass(currentSampleRate, 2000);     //const double highSampleRate = 1e6; // 1mil hz
-        juce::dsp::IIR::Coefficients<float>::Ptr coefficientsHigh = juce::dsp::IIR::Coefficients<float>::makeHighPass(currentSampleRate, 500); 
-        juce::dsp::IIR::Coefficients<float>::Ptr coefficientsLowAll = juce::dsp::IIR::Coefficients<float>::makeLowPass(currentSampleRate, 7000);
+    // Clear a stage's state in both channels, so it starts from silence after being bypassed
+    void clearLowPass()
+    {
+        lowPass.fill({});
+        lowPassSvf.fill({});
+    }
 
-        leftLowPass.coefficients = coefficientsLow;
-        rightLowPass.coefficients = coefficientsLow;
-        leftHighPass.coefficients = coefficientsHigh;
-        rightHighPass.coefficients = coefficientsHigh;
-        leftLowAll.coefficients = coefficientsLowAll;
-        rightLowAll.coefficients = coefficientsLowAll;
+    void clearHighPass()
+    {
+        highPass.fill({});
+        highPassSvf.fill({});
     }
 
     void resetSmoothing()
@@ -39,36 +316,88 @@ public:
         smoothedHighPassFreq.reset(currentSampleRate, 0.0075f);
     }
 
-    float processLowFilter(bool left, float sample)
+    float processLowFilter(int channel, float sample)
     {
-        if (left)
-            return leftLowPass.processSample(sample);
+        return Biquad::processSample(lowPassCoefficients, lowPass[channel], sample);
+    }
 
-        return rightLowPass.processSample(sample);
+    float processHighFilter(int channel, float sample)
+    {
+        return Biquad::processSample(highPassCoefficients, highPass[channel], sample);
     }
 
-    float processHighFilter(bool left, float sample)
+    float processLowFilter(int channel, float sample, const StateVariableFilter::Coefficients& coefficients)
     {
-        if (left)
-            return leftHighPass.processSample(sample);
-            
-        return rightHighPass.processSample(sample);
+        return StateVariableFilter::processSample(coefficients, lowPassSvf[channel], sample).lowPass;
     }
 
-    float processGeneralLowFilter(bool left, float sample)
+    float processHighFilter(int channel, float sample, const StateVariableFilter::Coefficients& coefficients)
     {
-        if (left)
-            return leftLowAll.processSample(sample);
+        return StateVariableFilter::processSample(coefficients, highPassSvf[channel], sample).highPass;
+    }
 
-        return rightLowAll.processSample(sample);
+    float processGeneralLowFilter(int channel, float sample)
+    {
+        return Biquad::processSample(lowAllCoefficients, lowAll[channel], sample);
+    }
+
+    //== BLOCK STAGES: a whole span through one filter (input and output may be the same buffer)
+    void processLowFilter(int channel, const float* input, float* output, int numSamples)
+    {
+        Biquad::processBlock(lowPassCoefficients, lowPass[channel], input, output, numSamples);
+    }
+
+    void processHighFilter(int channel, const float* input, float* output, int numSamples)
+    {
+        Biquad::processBlock(highPassCoefficients, highPass[channel], input, output, numSamples);
+    }
+
+    void processLowFilter(int channel, const float* input, float* output, int numSamples, const StateVariableFilter::Coefficients* coefficients)
+    {
+        StateVariableFilter::State state = lowPassSvf[channel];
+        for (int i = 0; i < numSamples; ++i)
+            output[i] = StateVariableFilter::processSample(coefficients[i], state, input[i]).lowPass;
+        lowPassSvf[channel] = state;
+    }
+
+    void processHighFilter(int channel, const float* input, float* output, int numSamples, const StateVariableFilter::Coefficients* coefficients)
+    {
+        StateVariableFilter::State state = highPassSvf[channel];
+        for (int i = 0; i < numSamples; ++i)
+            output[i] = StateVariableFilter::processSample(coefficients[i], state, input[i]).highPass;
+        highPassSvf[channel] = state;
+    }
+
+    void processGeneralLowFilter(int channel, float* samples, int numSamples)
+    {
+        Biquad::processBlock(lowAllCoefficients, lowAll[channel], samples, samples, numSamples);
+    }
+
+    //== STATE VARIABLE MODE: cutoffs glide per sample instead of per block
+    void setCutoffTargets(float newLowPassFreq, float newHighPassFreq)
+    {
+        smoothedLowPassFreq.setTargetValue(newLowPassFreq);
+        smoothedHighPassFreq.setTargetValue(newHighPassFreq);
+    }
+
+    void skipLowPassGlide(int numSamples) { smoothedLowPassFreq.skip(numSamples); }
+    void skipHighPassGlide(int numSamples) { smoothedHighPassFreq.skip(numSamples); }
+
+    StateVariableFilter::Coefficients getNextLowPassSvfCoefficients()
+    {
+        return StateVariableFilter::Coefficients::make(currentSampleRate, smoothedLowPassFreq.getNextValue());
+    }
+
+    StateVariableFilter::Coefficients getNextHighPassSvfCoefficients()
+    {
+        return StateVariableFilter::Coefficients::make(currentSampleRate, smoothedHighPassFreq.getNextValue());
     }
 
     void updateLowPassFilter(float newLowPassFreq, float coeff)
     {
         smoothedLowPassFreq.setTargetValue(newLowPassFreq);
         newLowPassFreq = applyOnePoleFilter(smoothedLowPassFreq.getCurrentValue(), smoothedLowPassFreq.getNextValue(), coeff);
-        updateLowCoefficients(leftLowPass, newLowPassFreq, currentSampleRate);
-        updateLowCoefficients(rightLowPass, newLowPassFreq, currentSampleRate);
+        updateLowCoefficients(newLowPassFreq);
         lastLowPassFreq = newLowPassFreq;
     }
 
@@ -76,21 +405,18 @@ public:
     {
         smoothedHighPassFreq.setTargetValue(newHighPassFreq);
         newHighPassFreq = applyOnePoleFilter(smoothedHighPassFreq.getCurrentValue(), smoothedHighPassFreq.getNextValue(), coeff);
-        updateHighCoefficients(leftHighPass, newHighPassFreq, currentSampleRate);
-        updateHighCoefficients(rightHighPass, newHighPassFreq, currentSampleRate);
+        updateHighCoefficients(newHighPassFreq);
         lastHighPassFreq = newHighPassFreq;
     }
 
-    void updateLowCoefficients(juce::dsp::IIR::Filter<float>& filter, float frequency, double sampleRate)
+    void updateLowCoefficients(float frequency)
     {
-        auto coefficients = juce::dsp::IIR::Coefficients<float>::makeLowPass(sampleRate, frequency);
-        filter.coefficients = coefficients;
+        lowPassCoefficients = lowPassTable.lookup(frequency);
     }
 
-    void updateHighCoefficients(juce::dsp::IIR::Filter<float>& filter, float frequency, double sampleRate)
+    void updateHighCoefficients(float frequency)
     {
-        auto coefficients = juce::dsp::IIR::Coefficients<float>::makeHighPass(sampleRate, frequency);
-        filter.coefficients = coefficients;
+        highPassCoefficients = highPassTable.lookup(frequency);
     }
 
     float applyOnePoleFilter(float current, float next, float coefficient)
@@ -101,6 +427,9 @@ public:
 private:
     double currentSampleRate;
 
-    juce::dsp::IIR::Filter<float> leftLowPass, rightLowPass, leftHighPass, rightHighPass, leftLowAll, rightLowAll;
+    CutoffTable lowPassTable, highPassTable;
+    Biquad::Coefficients lowPassCoefficients, highPassCoefficients, lowAllCoefficients;       // shared by both channels
+    std::array<Biquad::State, 2> lowPass, highPass, lowAll;     // [left, right] side by side
+    std::array<StateVariableFilter::State, 2> lowPassSvf, highPassSvf;
     juce::LinearSmoothedValue<float> smoothedLowPassFreq, smoothedHighPassFreq;
 };
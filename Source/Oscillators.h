@@ -0,0 +1,70 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Bank of recursive quadrature LFOs. Each oscillator is a unit phasor rotated by a fixed angle per step, so advancing
+// the whole bank is one short multiply-add loop with no sin/fmod and no phase wrapping. A first-order gain correction
+// per step keeps every phasor on the unit circle. sin/cos are only evaluated when a frequency changes
+// or a span is skipped.
+template <int numOscillators>
+class LfoBank
+{
+public:
+	LfoBank()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		sine.fill(0.f);
+		cosine.fill(1.f);
+		rotationSine.fill(0.f);
+		rotationCosine.fill(1.f);
+		angles.fill(0.0);
+	}
+
+	void setFrequency(int index, float frequency, double sampleRate)
+	{
+		const double angle = 2.0 * juce::MathConstants<double>::pi * frequency / sampleRate;
+		angles[index] = angle;
+		rotationSine[index] = static_cast<float>(std::sin(angle));
+		rotationCosine[index] = static_cast<float>(std::cos(angle));
+	}
+
+	// one step of every oscillator
+	void advance()
+	{
+		for (int i = 0; i < numPaddedOscillators; ++i)
+		{
+			const float s = sine[i] * rotationCosine[i] + cosine[i] * rotationSine[i];
+			const float c = cosine[i] * rotationCosine[i] - sine[i] * rotationSine[i];
+			const float gain = 1.5f - 0.5f * (s * s + c * c);
+			sine[i] = s * gain;
+			cosine[i] = c * gain;
+		}
+	}
+
+	// numSteps steps of every oscillator at once, for spans that are not processed
+	void skip(int numSteps)
+	{
+		for (int i = 0; i < numOscillators; ++i)
+		{
+			const double angle = angles[i] * numSteps;
+			const float rs = static_cast<float>(std::sin(angle));
+			const float rc = static_cast<float>(std::cos(angle));
+			const float s = sine[i] * rc + cosine[i] * rs;
+			cosine[i] = cosine[i] * rc - sine[i] * rs;
+			sine[i] = s;
+		}
+	}
+
+	float getSine(int index) const { return sine[index]; }
+	float getCosine(int index) const { return cosine[index]; }
+
+private:
+	static constexpr int numPaddedOscillators = (numOscillators + 3) & ~3;
+
+	alignas(16) std::array<float, numPaddedOscillators> sine, cosine, rotationSine, rotationCosine;
+	std::array<double, numOscillators> angles;
+};
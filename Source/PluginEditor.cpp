@@ -193,10 +193,9 @@ juce::String RotarySliderWithLabels::getDisplayString() const
 
     juce::String str;
 
-    if(auto* intParam = dynamic_cast<juce::AudioParameterInt*>(param))
+    if(dynamic_cast<juce::AudioParameterInt*>(param) != nullptr)
     {
-        auto val = getValue();
-        str = juce::String(val, 0);
+        str = param->getText(param->convertTo0to1(static_cast<float>(getValue())), 0); // the delay times read out as "Long Delay" scales them
     }
     else if (auto* floatParam = dynamic_cast<juce::AudioParameterFloat*>(param))
     {
@@ -260,6 +259,11 @@ DelayAudioProcessorEditor::DelayAudioProcessorEditor (DelayAudioProcessor& p)
         addAndMakeVisible(comp);
     }
 
+    for (const char* paramId : { "SVF Filters", "Interpolation", "Reverb Rate", "Delay Storage", "Delay Format", "Long Delay", "Long Delay Memory" })
+    {
+        addAndMakeVisible(settingBoxes.add(new ParameterBox(audioProcessor.apvts, paramId)));
+    }
+
     int width = audioProcessor.getAppProperties().getUserSettings()->getIntValue("WindowWidth", 1100);
     int height = audioProcessor.getAppProperties().getUserSettings()->getIntValue("WindowHeight", 575);
 
@@ -395,6 +399,12 @@ void DelayAudioProcessorEditor::paint (juce::Graphics& g)
         //     shadow.drawForRectangle(g, juce::Rectangle<int>(visualiserPosX[j], activeY, visualiserWidth, activeHeight));
         // }
     }
+
+    g.setFont(juce::Font(juce::FontOptions(typeface).withHeight(11.5f).withStyle("plain"))); // engine setting labels, above their boxes
+    for (auto* box : settingBoxes)
+    {
+        g.drawFittedText(box->getName(), box->getBounds().translated(0, -box->getHeight()), juce::Justification::centred, 1);
+    }
 }
 
 void DelayAudioProcessorEditor::resized()
@@ -460,6 +470,14 @@ void DelayAudioProcessorEditor::resized()
     float reverbSliderHeight = static_cast<float>(reverbSlider.getSliderBounds().getHeight());
     reverbSlider.setBounds(reverbSlider.getBounds().getX(), reverbSlider.getBounds().getY(), reverbSlider.getBounds().getWidth(), static_cast<int>(reverbSliderHeight * 1.17));
 
+    // engine settings: a row between the meters, below the knobs, each box with its label above it
+    auto settingsArea = getLocalBounds().removeFromBottom(44).reduced(static_cast<int>(windowWidth * 0.08f), 0).removeFromBottom(22).translated(0, -6);
+    const int settingWidth = settingsArea.getWidth() / juce::jmax(1, settingBoxes.size());
+    for (auto* box : settingBoxes)
+    {
+        box->setBounds(settingsArea.removeFromLeft(settingWidth).reduced(6, 0));
+    }
+
     int width = getWidth();
     int height = getHeight();
     audioProcessor.getAppProperties().getUserSettings()->setValue("WindowWidth", width);
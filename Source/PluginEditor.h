@@ -158,6 +158,25 @@ struct EnableButton : juce::ToggleButton, juce::Timer {
 
 //==============================================================================
 
+// A drop-down for one of the engine settings, listing the parameter's own value names ("Off" / "On" for switches)
+struct ParameterBox : juce::ComboBox
+{
+  ParameterBox(juce::AudioProcessorValueTreeState& apvts, const juce::String& paramId) : juce::ComboBox(paramId)
+  {
+    addItemList(apvts.getParameter(paramId)->getAllValueStrings(), 1);
+    setColour(juce::ComboBox::backgroundColourId, juce::Colours::black);
+    setColour(juce::ComboBox::outlineColourId, juce::Colour(63u, 72u, 204u));
+    setColour(juce::ComboBox::textColourId, juce::Colours::white);
+    setColour(juce::ComboBox::arrowColourId, juce::Colours::white);
+    attachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(apvts, paramId, *this);
+  }
+
+private:
+  std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> attachment;
+};
+
+//==============================================================================
+
 struct BPMLabel : juce::Label
 {
   BPMLabel()
@@ -224,6 +243,8 @@ private:
     // EnableButton dualDelayButton;
     // ButtonAttachment dualDelayButtonAttachment;
 
+    juce::OwnedArray<ParameterBox> settingBoxes; // engine settings, in a row along the bottom
+
     BPMLabel bpmLabel;
     void updateBPMLabel();
     float lastBPM = 120.f;
@@ -3,6 +3,7 @@
 #include "DelayLine.h"
 #include "ReverbLines.h"
 #include "Filters.h"
+#include "Oscillators.h"
 
 //==============================================================================
 DelayAudioProcessor::DelayAudioProcessor()
@@ -25,6 +26,7 @@ DelayAudioProcessor::DelayAudioProcessor()
 
 DelayAudioProcessor::~DelayAudioProcessor()
 {
+    stopTimer();
     // juce::File Log("build/Delay_artefacts/Debug/Standalone/feedback.txt"); // log making
     // juce::FileLogger Logger(feedbackLog, "Log Message");
     // Logger.logMessage("Value: " + juce::String(delayTimeLeft));
@@ -98,14 +100,71 @@ void DelayAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
     const juce::dsp::ProcessSpec spec{sampleRate, static_cast<juce::uint32>(samplesPerBlock), 2};
 
     currentSampleRate = getSampleRate();
-    leftDelay = std::make_unique<DelayLine>(currentSampleRate);
-    rightDelay = std::make_unique<DelayLine>(currentSampleRate);
+    engineSampleRate = currentSampleRate;
+    const ChainSettings settings = getChainSettings(apvts);
+    stopTimer();   // a callback already running may finish, but the builders start nothing from settle until resume
+
+    // Hosts re-prepare on transport and block size changes. What keeps its layout is kept as it is: echoes, reverb,
+    // LFO phases and glides carry on, and nothing is allocated or cleared. A handover in progress is dropped.
+
+    //== DELAY ENGINE (with history resampled into a new one when "Delay Storage", "Delay Format", "Long Delay",
+    //== "Long Delay Memory" or the sample rate changed while audio was stopped)
+    delayEngine = delayEngines.settle(delayEngine);
+    nextDelayEngine = nullptr;
+    handoverDelayScale = 1.f;
+    const DelayEngine::Layout delayLayout = getDelayLayout(settings, currentSampleRate);
+
+    if (delayEngine == nullptr || ! (delayEngine->layout == delayLayout))
+    {
+        delayEngine = delayEngines.rebuild(delayLayout, [sameRate = delayEngine != nullptr && delayEngine->layout.sampleRate == currentSampleRate]
+                                                        (DelayEngine* previous, DelayEngine& engine)
+        {
+            if (previous == nullptr)
+                return;
+
+            for (size_t lane = 0; lane < engine.delayLines.size(); ++lane)
+            {
+                const float historyTime = juce::jmin(previous->layout.bufferDelayTime, engine.layout.bufferDelayTime);
+                engine.delayLines[lane].restoreHistory(previous->delayLines[lane].getHistory(historyTime));
+                engine.delayLines[lane].takeTimingFrom(previous->delayLines[lane]);
+                if (engine.layout.longDelay != previous->layout.longDelay)     // "Long Delay" rescales the times: start there, not glide there
+                    engine.delayLines[lane].holdDelayTime(previous->delayLines[lane].getSmoothedCurrent() * getDelayTimeScale(engine.layout.longDelay)
+                                                                                                           / getDelayTimeScale(previous->layout.longDelay));
+                if (! sameRate)
+                    engine.delayLines[lane].resetSmoothedValue(DelayEngine::glideTime);   // glide steps for the new rate; lands on the target
+            }
+        });
+    }
+
+    //== REVERB ENGINE ("Reverb Rate": 0 = host rate, 1 = half, 2 = quarter; built once the reverb is wanted)
+    reverbEngine = reverbEngines.settle(reverbEngine);
+    nextReverbEngine = nullptr;
+    const ReverbEngine::Layout reverbLayout { currentSampleRate, 1 << settings.reverbRate };
+    const bool reverbWanted = reverbEngine != nullptr || settings.reverb || reverbRequested.load();
+
+    if (reverbWanted && (reverbEngine == nullptr || ! (reverbEngine->layout == reverbLayout)))
+        reverbEngine = reverbEngines.rebuild(reverbLayout, [](ReverbEngine*, ReverbEngine&) {});
+
+    reverbRequested = false;
+    delayEngines.resume();
+    reverbEngines.resume();
+    startTimer(serviceInterval);   // delay pages and later engines are allocated and freed off the audio thread
+
+    if (currentSampleRate == preparedSampleRate)
+        return;
+
+    preparedSampleRate = currentSampleRate;
+    quietSamples = 0;
+    asleep = false;
 
     //== LOW PASS & HIGH PASS
-    filters = std::make_unique<Filters>(currentSampleRate);
+    arena.reset(DspArena::getBytesFor<Filters>());
+    filters = arena.create<Filters>(currentSampleRate);
 
-    //== REVERB LINES
-    reverbLines = std::make_unique<ReverbLines>(currentSampleRate);
+    //== LFOS (the chorus and reverb LFOs have always run at twice their nominal rates)
+    lfos.reset();
+    lfos.setFrequency(chorusLfo, 2.0f * chorusRate, currentSampleRate);
+    lfos.setFrequency(reverbLfo, 2.0f * ReverbLines::reverbModRate, currentSampleRate);
 
     //== ONE-POLE FILTER COEFFICIENTS
     coeff = 1.0f - static_cast<float>(std::exp( -1.0f / (0.1f * currentSampleRate)));
@@ -113,26 +172,36 @@ void DelayAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
     coeff_lrg = 1.0f - static_cast<float>(std::exp( -1.0f / (0.5f * currentSampleRate)));
 
     //== SMOOTHING
-    leftDelay->resetSmoothedValue(0.7f);
-    rightDelay->resetSmoothedValue(0.7f);
+    for (auto& delayLine : delayEngine->delayLines)
+        delayLine.resetSmoothedValue(DelayEngine::glideTime);
     smoothedFeedback.reset(currentSampleRate, 0.005f);
     smoothedDryWet.reset(currentSampleRate, 0.005f);
     smoothedChorus.reset(currentSampleRate, 77.7f);
-    smoothedReverb.reset(currentSampleRate, 0.7f);
+    smoothedReverb.reset(currentSampleRate, 0.35f);          // mix ramps step once per stereo frame
     smoothedReverbLevel.reset(currentSampleRate, 0.0075f);
-    smoothedLowPassMix.reset(currentSampleRate, 0.7f);
-    smoothedHighPassMix.reset(currentSampleRate, 0.7f);
+    smoothedLowPassMix.reset(currentSampleRate, 0.35f);
+    smoothedHighPassMix.reset(currentSampleRate, 0.35f);
     filters->resetSmoothing();
-
-    //== CIRCULAR BUFFER
-    leftDelay->makeBuffer();
-    rightDelay->makeBuffer();
 }
 
 
 void DelayAudioProcessor::releaseResources()
 {
-    // When playback stops, you can use this as an opportunity to free up any spare memory, etc.
+    // Deactivated: the arenas go to the process-wide pool and long-delay memory is freed. The next prepareToPlay
+    // builds from scratch, taking back pooled memory of the same size when there is some.
+    engineSampleRate = 0.0;
+    stopTimer();
+    delayEngines.release();
+    delayEngine = nullptr;
+    nextDelayEngine = nullptr;
+    reverbEngines.release();
+    reverbEngine = nullptr;
+    nextReverbEngine = nullptr;
+    reverbRequested = false;
+
+    filters = nullptr;
+    arena.release();
+    preparedSampleRate = 0.0;
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -181,24 +250,36 @@ void DelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, [[mayb
     float newHighPassFreq = chainsettings.highPassFreq;
     bool reverb = chainsettings.reverb;
     float newReverbLevel = chainsettings.reverbLevel;
-    float newDelayTimeLeft = chainsettings.delayTimeLeft;
-    float newDelayTimeRight = dualDelay ? chainsettings.delayTimeRight : chainsettings.delayTimeLeft;
+    const float delayTimeScale = getDelayTimeScale(delayEngine->layout.longDelay);
+    float newDelayTimeLeft = chainsettings.delayTimeLeft * delayTimeScale;
+    float newDelayTimeRight = (dualDelay ? chainsettings.delayTimeRight : chainsettings.delayTimeLeft) * delayTimeScale;
     float newInputSignalLevel = 0.f;
     float newOutputSignalLevel = 0.f;
 
+    //== ENGINES (the reverb lines are asked for the first time "Reverb" is on; the mix fades them in once built)
+    adoptEngines({ newDelayTimeLeft, newDelayTimeRight });
+    if (reverb && reverbEngine == nullptr)
+        reverbRequested.store(true, std::memory_order_relaxed);
+
     //== TOGGLE MIXES
-    toggleButtonStateMixes(lowPass, highPass, chorus, reverb);
+    toggleButtonStateMixes(lowPass, highPass, chorus, reverb && reverbEngine != nullptr);
 
     //== COEFFICIENTS
-    if (newLowPassFreq != filters->lastLowPassFreq)
-        filters->updateLowPassFilter(newLowPassFreq, coeff);
+    useStateVariableFilters = chainsettings.svfFilters;
+    interpolationQuality = static_cast<Interpolation::Quality>(chainsettings.interpolationQuality);
+
+    if (useStateVariableFilters)
+        filters->setCutoffTargets(newLowPassFreq, newHighPassFreq);
 
-    if (newHighPassFreq != filters->lastHighPassFreq)
-        filters->updateHighPassFilter(newHighPassFreq, coeff);
+    lowPassCutoff = newLowPassFreq;     // biquad mode glides towards these a span at a time (see processSubBlock)
+    highPassCutoff = newHighPassFreq;
 
     //== CHORUS RATE
     if (newChorusRate != chorusRate)
+    {
         chorusRate = newChorusRate;
+        lfos.setFrequency(chorusLfo, 2.0f * chorusRate, currentSampleRate);
+    }
 
     //== SMOOTHING
     smoothedFeedback.setTargetValue(newFeedbackTime);
@@ -212,93 +293,311 @@ void DelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, [[mayb
     dryWetRight = setDryWetMix(newDelayTimeRight, dryWet, newDryWet, smoothedDryWet);
 
     //== REVERB DELAY TIMES
-    reverbLines->updateTargetDelayTimes();
+    if (reverbEngine != nullptr)
+        reverbEngine->lines->updateTargetDelayTimes();
+    if (nextReverbEngine != nullptr)
+        nextReverbEngine->lines->updateTargetDelayTimes();
+
+    //== SLEEP (input, echoes and reverb have all been silent for longer than any buffer reaches back, so nothing can come
+    //== out but silence: the input is passed through and only the ramps and LFOs move on, until input arrives)
+    std::array<float, 2> newDelayTimes { newDelayTimeLeft, newDelayTimeRight };
+    const int numLanes = juce::jmin(numChannels, 2);
+
+    if (asleep)
+    {
+        const bool inputSilent = buffer.hasBeenCleared() || buffer.getMagnitude(0, numSamples) < silenceThreshold;
+        asleep = inputSilent && nextDelayEngine == nullptr && nextReverbEngine == nullptr;
+
+        if (asleep)
+        {
+            skipBlock(newDelayTimes, numLanes, numSamples);
+            inputSignalLevel = 0.f;
+            outputSignalLevel = 0.f;
+            return;
+        }
+
+        quietSamples = 0;
+    }
 
     //== PROCESSING LOOP
-    for (int channel = 0; channel < numChannels; ++channel)
+    const std::array<float, 2> dryWets { dryWetLeft, dryWetRight };
+    float* const* channelData = buffer.getArrayOfWritePointers();
+    float tailPeak = 0.f;
+
+    for (int start = 0; start < numSamples; start += subBlockSize)
+    {
+        const int blockSamples = juce::jmin(subBlockSize, numSamples - start);
+
+        if (numChannels > 1)
+            processSubBlock<2>(channelData, start, blockSamples, newDelayTimes, dryWets, newInputSignalLevel, newOutputSignalLevel);
+        else if (numChannels == 1)
+            processSubBlock<1>(channelData, start, blockSamples, newDelayTimes, dryWets, newInputSignalLevel, newOutputSignalLevel);
+
+        for (int lane = 0; lane < numLanes; ++lane)
+            for (int i = 0; i < blockSamples; ++i)
+                tailPeak = fmaxf(tailPeak, fmaxf(fabsf(wetSamples[lane][i]), fabsf(reverbSamples[lane][i])));
+
+        const float delayScale = handoverDelayScale;
+        advanceHandovers(blockSamples);
+        if (delayScale != 1.f && nextDelayEngine == nullptr)     // the engine that took over runs at the rescaled times
+            for (float& delayTime : newDelayTimes)
+                delayTime *= delayScale;
+    }
+
+    inputSignalLevel = fminf(newInputSignalLevel * 1.25f, 1.0f);       // keep it below 1
+    outputSignalLevel = fminf(newOutputSignalLevel * 1.25f, 1.0f);
+
+    // the echoes and reverb are read before they are mixed, so tails that are ringing on inaudibly keep it awake
+    if (newInputSignalLevel < silenceThreshold && tailPeak < silenceThreshold)
+        quietSamples += numSamples;
+    else
+        quietSamples = 0;
+
+    float reachTime = delayEngine->layout.bufferDelayTime;     // ms
+    if (reverbEngine != nullptr)
+        reachTime = juce::jmax(reachTime, reverbEngine->lines->getMemoryTime());
+
+    asleep = quietSamples > static_cast<juce::int64>(reachTime * currentSampleRate / 1000.0)
+          && nextDelayEngine == nullptr && nextReverbEngine == nullptr;
+}
+
+// Moves everything that runs per sample on by a block that is not processed, so waking up sounds as if it had been
+void DelayAudioProcessor::skipBlock(const std::array<float, 2>& newDelayTimes, int numLanes, int numSamples)
+{
+    lfos.skip(numSamples);
+    chorusModulation = chorusDepth * lfos.getSine(chorusLfo);
+    smoothedChorus.skip(numSamples);
+    currentLowPassMix = smoothedLowPassMix.skip(numSamples);
+    currentHighPassMix = smoothedHighPassMix.skip(numSamples);
+    currentReverbMix = smoothedReverb.skip(numSamples);
+
+    if (useStateVariableFilters)
+    {
+        filters->skipLowPassGlide(numSamples);
+        filters->skipHighPassGlide(numSamples);
+    }
+
+    for (int lane = 0; lane < numLanes; ++lane)     // targets as applyChorus sets them
+        delayEngine->delayLines[lane].skipGlide(newDelayTimes[lane] != 0.f ? newDelayTimes[lane] + chorusModulation : 0.f, numSamples);
+}
+
+template <int numLanes>
+void DelayAudioProcessor::processSubBlock(float* const* channelData, int start, int numSamples, const std::array<float, 2>& newDelayTimes, const std::array<float, 2>& dryWets, float& inputPeak, float& outputPeak)
+{
+    //== STAGE BYPASS (a stage whose mix has settled at 0 is not run; when its mix rises again it is cleared first,
+    //== so it fades in from silence rather than from the tail it was cut off in. The timer clears the reverb lines,
+    //== and the reverb stays bypassed until it has.)
+    const bool lowPassOn = isStageActive(smoothedLowPassMix);
+    const bool highPassOn = isStageActive(smoothedHighPassMix);
+    const bool chorusOn = isStageActive(smoothedChorus);
+    const bool reverbOn = reverbEngine != nullptr && isStageActive(smoothedReverb)
+                          && (reverbRunning || (reverbEngine->isClear() && (nextReverbEngine == nullptr || nextReverbEngine->isClear())));
+
+    if (lowPassOn && ! lowPassRunning)
+        filters->clearLowPass();
+
+    if (highPassOn && ! highPassRunning)
+        filters->clearHighPass();
+
+    if (reverbEngine != nullptr && reverbOn != reverbRunning)
+    {
+        reverbEngine->setInUse(reverbOn);
+        if (nextReverbEngine != nullptr)
+            nextReverbEngine->setInUse(reverbOn);
+    }
+
+    lowPassRunning = lowPassOn;
+    highPassRunning = highPassOn;
+    reverbRunning = reverbOn;
+
+    //== BIQUAD CUTOFFS (one glide step and a table lookup per span)
+    if (! useStateVariableFilters)
+    {
+        if (lowPassCutoff != filters->lastLowPassFreq)
+            filters->updateLowPassFilter(lowPassCutoff, coeff);
+
+        if (highPassCutoff != filters->lastHighPassFreq)
+            filters->updateHighPassFilter(highPassCutoff, coeff);
+    }
+
+    //== CHORUS, DELAY TIMES & FILTER MIXES (one pass over stereo frames; the chorus LFO also moves the delay time
+    //== targets, so it runs whether or not the chorus does)
+    for (int i = 0; i < numSamples; ++i)
+    {
+        if (chorusOn)
+            smoothedChorus.skip(numLanes * (start + i));
+        lfos.advance();
+        chorusModulation = chorusDepth * lfos.getSine(chorusLfo);
+        reverbLfoValues[i] = lfos.getSine(reverbLfo);
+
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            inputPeak = fmaxf(inputPeak, fabsf(channelData[lane][start + i]));
+            DelayLine& delayLine = delayEngine->delayLines[lane];
+            delayTimes[lane][i] = juce::jmin(applyChorus(smoothedChorus.getCurrentValue(), delayLine, newDelayTimes[lane]), static_cast<double>(delayEngine->layout.bufferDelayTime));
+            delayLine.updateDelayTime(delayTimes[lane][i]);
+
+            // the next engine reads where this one does, or at its own times when the handover changes "Long Delay"
+            if (nextDelayEngine != nullptr)
+            {
+                DelayLine& nextDelayLine = nextDelayEngine->delayLines[lane];
+                nextDelayTimes[lane][i] = handoverDelayScale == 1.f ? delayTimes[lane][i]
+                                                                    : juce::jmin(applyChorus(smoothedChorus.getCurrentValue(), nextDelayLine, newDelayTimes[lane] * handoverDelayScale),
+                                                                                 static_cast<double>(nextDelayEngine->layout.bufferDelayTime));
+                nextDelayLine.updateDelayTime(nextDelayTimes[lane][i]);
+            }
+        }
+
+        lowPassMixes[i] = smoothedLowPassMix.getNextValue();
+        highPassMixes[i] = smoothedHighPassMix.getNextValue();
+
+        if (useStateVariableFilters)
+        {
+            if (lowPassOn)
+                lowPassSvfCoefficients[i] = filters->getNextLowPassSvfCoefficients();
+            if (highPassOn)
+                highPassSvfCoefficients[i] = filters->getNextHighPassSvfCoefficients();
+        }
+    }
+
+    if (useStateVariableFilters)
+    {
+        if (! lowPassOn)
+            filters->skipLowPassGlide(numSamples);
+        if (! highPassOn)
+            filters->skipHighPassGlide(numSamples);
+    }
+
+    currentLowPassMix = lowPassMixes[numSamples - 1];
+    currentHighPassMix = highPassMixes[numSamples - 1];
+
+    //== DELAY & FEEDBACK FILTERS (block stages per lane when the delay allows it, else one recursive span;
+    //== during a handover the next engine shadows this one, then their reads are crossfaded)
+    const bool delayFading = nextDelayEngine != nullptr && ! delayHandover.isShadowing();
+    if (delayFading)
+        delayHandover.getFades(handoverFades.data(), numSamples);
+
+    for (int lane = 0; lane < numLanes; ++lane)
     {
-    const float* inData = buffer.getReadPointer(channel);
-    float* outData = buffer.getWritePointer(channel);
+        auto processFeedback = [this, lane, lowPassOn, highPassOn](int i, float delayedSample)
+        {
+            //== LOW PASS
+            if (lowPassOn)
+            {
+                float lowPassSample = useStateVariableFilters ? filters->processLowFilter(lane, delayedSample, lowPassSvfCoefficients[i])
+                                                              : filters->processLowFilter(lane, delayedSample);
+                delayedSample = (1.0f - lowPassMixes[i]) * delayedSample + lowPassMixes[i] * lowPassSample;
+            }
+
+            //== HIGH PASS
+            if (highPassOn)
+            {
+                float highPassSample = useStateVariableFilters ? filters->processHighFilter(lane, delayedSample, highPassSvfCoefficients[i])
+                                                               : filters->processHighFilter(lane, delayedSample);
+                delayedSample = (1.0f - highPassMixes[i]) * delayedSample + highPassMixes[i] * highPassSample;
+            }
+
+            //== GENERAL LOW PASS
+            return filters->processGeneralLowFilter(lane, delayedSample);
+        };
 
-        for (int sample = 0; sample < numSamples; ++sample)
+        auto processFeedbackBlock = [this, lane, lowPassOn, highPassOn](float* delayedSamples, int blockSize)
         {
-            newInputSignalLevel = fmaxf(newInputSignalLevel, fabsf(inData[sample]));
-            inputSignalLevel = newInputSignalLevel * 1.25f;
-            inputSignalLevel = fminf(inputSignalLevel, 1.0f);       // keep it below 1
+            float* filtered = filteredSamples.data();
 
-            if (channel == 0) //== LEFT CHANNEL
+            //== LOW PASS
+            if (lowPassOn)
             {
-                //== CHORUS & DELAY
-                smoothedChorus.skip(sample); 
-                float newDelay = applyChorus(sample, smoothedChorus.getCurrentValue(), *leftDelay, newDelayTimeLeft);
-                leftDelay->updateDelayTime(newDelay);
-
-                float delayedSample = leftDelay->readBufferDelayedSample();
-
-                //== LOW PASS
-                currentLowPassMix = smoothedLowPassMix.getNextValue();
-                float lowPassSample = filters->processLowFilter(true, delayedSample);          
-                delayedSample = (1.0f - currentLowPassMix) * delayedSample + currentLowPassMix * lowPassSample;
-
-                //== HIGH PASS
-                currentHighPassMix = smoothedHighPassMix.getNextValue();
-                float highPassSample = filters->processHighFilter(true, delayedSample);
-                delayedSample = (1.0f - currentHighPassMix) * delayedSample + currentHighPassMix * highPassSample;
-
-                //== GENERAL LOW PASS
-                delayedSample = filters->processGeneralLowFilter(true, delayedSample);
-                
-                //== MIXING
-                leftDelay->writeDelayBuffer(inData[sample], feedbackTime, delayedSample);
-                float wetScale = (1.0f - dryWetLeft) + dryWetLeft * 0.5f;  // making this to control the volume changes when mixing dry/wet signals
-                outData[sample] = wetScale * inData[sample] + dryWetLeft * delayedSample;  // dry / wet   //outData[sample] = delayedSample; // 100% wet  // outData[sample] = (1.0f - dryWet) * inData[sample] + dryWet * delayedSample; // original
-                leftDelay->updateWriteIndex();
-
-                //== REVERB
-                float combinedReverb = reverbLines->applyReverb(true, inData[sample], reverbLevel);
-                float wetReverb = (1.0f - reverbLevel) + reverbLevel * 0.5f;
-                combinedReverb = wetReverb * outData[sample] + reverbLevel * combinedReverb;
-                currentReverbMix = smoothedReverb.getNextValue();       
-                outData[sample] += (1.0f - currentReverbMix) * outData[sample] + currentReverbMix * combinedReverb;
+                if (useStateVariableFilters)
+                    filters->processLowFilter(lane, delayedSamples, filtered, blockSize, lowPassSvfCoefficients.data());
+                else
+                    filters->processLowFilter(lane, delayedSamples, filtered, blockSize);
+
+                for (int i = 0; i < blockSize; ++i)
+                    delayedSamples[i] = (1.0f - lowPassMixes[i]) * delayedSamples[i] + lowPassMixes[i] * filtered[i];
             }
-            else if (channel == 1) //== RIGHT CHANNEL
+
+            //== HIGH PASS
+            if (highPassOn)
             {
-                //== CHORUS & DELAY
-                smoothedChorus.skip(sample); 
-                float newDelay = applyChorus(sample, smoothedChorus.getCurrentValue(), *rightDelay, newDelayTimeRight);
-                rightDelay->updateDelayTime(newDelay);
-
-                float delayedSample = rightDelay->readBufferDelayedSample();
-
-                //== LOW PASS
-                currentLowPassMix = smoothedLowPassMix.getNextValue(); 
-                float lowPassSample = filters->processLowFilter(false, delayedSample);
-                delayedSample = (1.0f - currentLowPassMix) * delayedSample + currentLowPassMix * lowPassSample;
-
-                //== HIGH PASS
-                currentHighPassMix = smoothedHighPassMix.getNextValue(); 
-                float highPassSample = filters->processHighFilter(false, delayedSample);
-                delayedSample = (1.0f - currentHighPassMix) * delayedSample + currentHighPassMix * highPassSample;
-
-                ///== GENERAL LOW PASS
-                delayedSample = filters->processGeneralLowFilter(false, delayedSample);
-
-                //== MIXING
-                rightDelay->writeDelayBuffer(inData[sample], feedbackTime, delayedSample);
-                float wetScale = (1.0f - dryWetRight) + dryWetRight * 0.5f;
-                outData[sample] = wetScale * inData[sample] + dryWetRight * delayedSample; 
-                rightDelay->updateWriteIndex();
-
-                //== REVERB;
-                float combinedReverb = reverbLines->applyReverb(false, inData[sample], reverbLevel);
-                float wetReverb = (1.0f - reverbLevel) + reverbLevel * 0.5f;
-                combinedReverb = wetReverb * outData[sample] + reverbLevel * combinedReverb;
-                currentReverbMix = smoothedReverb.getNextValue();       
-                outData[sample] += (1.0f - currentReverbMix) * outData[sample] + currentReverbMix * combinedReverb;
+                if (useStateVariableFilters)
+                    filters->processHighFilter(lane, delayedSamples, filtered, blockSize, highPassSvfCoefficients.data());
+                else
+                    filters->processHighFilter(lane, delayedSamples, filtered, blockSize);
+
+                for (int i = 0; i < blockSize; ++i)
+                    delayedSamples[i] = (1.0f - highPassMixes[i]) * delayedSamples[i] + highPassMixes[i] * filtered[i];
             }
-            newOutputSignalLevel = fmaxf(newOutputSignalLevel, fabsf(outData[sample]));
-            outputSignalLevel = newOutputSignalLevel * 1.25f;
-            outputSignalLevel = fminf(outputSignalLevel, 1.0f);       // keep it below 1
+
+            //== GENERAL LOW PASS
+            filters->processGeneralLowFilter(lane, delayedSamples, blockSize);
+        };
+
+        DelayLine& delayLine = delayEngine->delayLines[lane];
+        float* const in = channelData[lane] + start;
+
+        if (delayFading)
+        {
+            delayLine.processBlended(nextDelayEngine->delayLines[lane], in, wetSamples[lane].data(), numSamples, delayTimes[lane].data(), nextDelayTimes[lane].data(),
+                                     feedbackTime, interpolationQuality, handoverFades.data(), processFeedback);
+            continue;
+        }
+
+        delayLine.process(in, wetSamples[lane].data(), numSamples, delayTimes[lane].data(), feedbackTime, interpolationQuality, processFeedback, processFeedbackBlock);
+
+        if (nextDelayEngine != nullptr)
+            nextDelayEngine->delayLines[lane].follow(in, wetSamples[lane].data(), feedbackTime, numSamples, nextDelayTimes[lane].data());
+    }
+
+    //== MIXING (dry / wet, frame by frame)
+    std::array<float, 2> wetScales;
+    for (int lane = 0; lane < numLanes; ++lane)
+        wetScales[lane] = (1.0f - dryWets[lane]) + dryWets[lane] * 0.5f;  // making this to control the volume changes when mixing dry/wet signals
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            float& out = channelData[lane][start + i];
+            out = wetScales[lane] * out + dryWets[lane] * wetSamples[lane][i];  // dry / wet   //out = wetSamples[lane][i]; // 100% wet  // out = (1.0f - dryWet) * out + dryWet * wetSamples[lane][i]; // original
+        }
+    }
+
+    //== REVERB (whole span, fed from the mixed output; silent until the lines are built and while bypassed)
+    if (reverbOn)
+        reverbEngine->lines->process(channelData[0] + start, channelData[numLanes - 1] + start, reverbSamples[0].data(), reverbSamples[1].data(),
+                                     numSamples, reverbLevel, reverbLfoValues.data());
+    else
+        for (auto& lane : reverbSamples)
+            std::fill_n(lane.data(), numSamples, 0.f);
+
+    // the next reverb engine is fed alongside while it is handed over to, then crossfaded in
+    if (reverbOn && nextReverbEngine != nullptr)
+    {
+        nextReverbEngine->lines->process(channelData[0] + start, channelData[numLanes - 1] + start, nextReverbSamples[0].data(), nextReverbSamples[1].data(),
+                                         numSamples, reverbLevel, reverbLfoValues.data());
+
+        if (! reverbHandover.isShadowing())
+        {
+            reverbHandover.getFades(handoverFades.data(), numSamples);
+            for (int lane = 0; lane < numLanes; ++lane)
+                for (int i = 0; i < numSamples; ++i)
+                    reverbSamples[lane][i] += handoverFades[i] * (nextReverbSamples[lane][i] - reverbSamples[lane][i]);
+        }
+    }
+
+    float wetReverb = (1.0f - reverbLevel) + reverbLevel * 0.5f;
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        currentReverbMix = smoothedReverb.getNextValue();
+
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            float& out = channelData[lane][start + i];
+            float combinedReverb = wetReverb * out + reverbLevel * reverbSamples[lane][i];
+            out += (1.0f - currentReverbMix) * out + currentReverbMix * combinedReverb;
+            outputPeak = fmaxf(outputPeak, fabsf(out));
         }
     }
 }
@@ -331,16 +630,8 @@ void DelayAudioProcessor::setStateInformation (const void* data, int sizeInBytes
     }
 }
 
-[[nodiscard]] float DelayAudioProcessor::applyChorus(int sample, float currentMixValue, DelayLine& delayLine, float newDelayTime)
+[[nodiscard]] double DelayAudioProcessor::applyChorus(float currentMixValue, DelayLine& delayLine, float newDelayTime)
 {
-    chorusModulation = chorusDepth * static_cast<float>(std::sin(2.0f * juce::MathConstants<float>::pi * chorusRate * sample / currentSampleRate + chorusPhase));
-    chorusPhase += 2.0f * static_cast<float>(juce::MathConstants<float>::pi * chorusRate / currentSampleRate);
-    chorusPhase = std::fmod(chorusPhase, 2.0f * juce::MathConstants<float>::pi);
-    if (chorusPhase < 0)
-    {
-        chorusPhase += 2.0f * juce::MathConstants<float>::pi;
-    }
-
     if (newDelayTime != delayLine.getSmoothedCurrent() && newDelayTime != 0.f) 
     {
         delayLine.setNewTarget(newDelayTime + chorusModulation); // target + chorus + large ramp = yes
@@ -350,8 +641,8 @@ void DelayAudioProcessor::setStateInformation (const void* data, int sizeInBytes
         delayLine.setNewTarget(newDelayTime);
     }
 
-    float delayedSample = delayLine.getCurrentDelayTime();
-    delayedSample = applyOnePoleFilter(delayedSample, delayLine.getSmoothedNext(), coeff_sml); // need to apply chorus to sample after this, even though it pops
+    double delayedSample = delayLine.getCurrentDelayTime();
+    delayedSample = applyOnePoleFilter(delayedSample, delayLine.getSmoothedNext(), static_cast<double>(coeff_sml)); // need to apply chorus to sample after this, even though it pops
 
     if (newDelayTime != 0.f) // bypass chorus even when enabled
     {
@@ -361,11 +652,118 @@ void DelayAudioProcessor::setStateInformation (const void* data, int sizeInBytes
     return delayedSample;
 }
 
+void DelayAudioProcessor::timerCallback()
+{
+    const double sampleRate = engineSampleRate.load();
+    if (sampleRate <= 0.0)
+        return;
+
+    const ChainSettings settings = getChainSettings(apvts);
+    delayEngines.update(getDelayLayout(settings, sampleRate), true);
+    reverbEngines.update({ sampleRate, 1 << settings.reverbRate }, reverbRequested.load(std::memory_order_relaxed));
+
+    // the refill runs under the builder's lock, so prepareToPlay and releaseResources never free pages under it
+    delayEngines.forEachEngine([](DelayEngine& engine)
+    {
+        for (auto& delayLine : engine.delayLines)
+            delayLine.providePages();
+    });
+
+    reverbEngines.forEachEngine([](ReverbEngine& engine) { engine.clearIfSetAside(); });
+}
+
+DelayEngine::Layout DelayAudioProcessor::getDelayLayout(const ChainSettings& settings, double sampleRate) const
+{
+    const auto delayMemory = ! settings.longDelay ? DelayLine::Memory::heap
+                                                  : (settings.longDelayMemory == 1 ? DelayLine::Memory::mapped : DelayLine::Memory::paged);
+    return { sampleRate, settings.longDelay, 1 << settings.delayStorage, settings.delayFormat, delayMemory, getDelayBufferTime(settings.longDelay) };
+}
+
+// Audio thread: takes on engines the timer has had built. The delay engine shadows the current one for as long as the
+// longest delay reaches back, so the history it is crossfaded to is the same. When "Long Delay" changes, the next engine
+// is held at its own, rescaled times from the start and only those need history; the crossfade then goes straight from
+// the old echoes to the new ones. A first reverb engine is used right away.
+void DelayAudioProcessor::adoptEngines(const std::array<float, 2>& newDelayTimes)
+{
+    if (nextDelayEngine == nullptr && (nextDelayEngine = delayEngines.adopt()) != nullptr)
+    {
+        handoverDelayScale = getDelayTimeScale(nextDelayEngine->layout.longDelay) / getDelayTimeScale(delayEngine->layout.longDelay);
+
+        float longestDelay = 0.f;
+        for (size_t lane = 0; lane < delayEngine->delayLines.size(); ++lane)
+        {
+            if (handoverDelayScale == 1.f)
+            {
+                longestDelay = juce::jmax(longestDelay, newDelayTimes[lane], static_cast<float>(delayEngine->delayLines[lane].getSmoothedCurrent()));
+            }
+            else
+            {
+                const float nextDelayTime = juce::jmin(newDelayTimes[lane] * handoverDelayScale, nextDelayEngine->layout.bufferDelayTime);
+                nextDelayEngine->delayLines[lane].holdDelayTime(nextDelayTime);
+                longestDelay = juce::jmax(longestDelay, nextDelayTime);
+            }
+        }
+
+        const float shadowTime = juce::jmin(longestDelay + 2.0f * chorusDepth, nextDelayEngine->layout.bufferDelayTime);
+        delayHandover.start(static_cast<int>(std::ceil(shadowTime * currentSampleRate / 1000.0)), currentSampleRate);
+    }
+
+    if (nextReverbEngine == nullptr)
+    {
+        if (ReverbEngine* const adopted = reverbEngines.adopt())
+        {
+            if (reverbEngine == nullptr)
+            {
+                reverbEngine = adopted;
+            }
+            else
+            {
+                nextReverbEngine = adopted;
+                reverbHandover.start(static_cast<int>(ReverbEngine::shadowTime * currentSampleRate), currentSampleRate);
+            }
+        }
+    }
+}
+
+// Audio thread, after each span: finishes handovers whose crossfade is complete and hands the old engines back
+void DelayAudioProcessor::advanceHandovers(int numSamples)
+{
+    if (nextDelayEngine != nullptr && delayHandover.advance(numSamples))
+    {
+        if (handoverDelayScale == 1.f)     // else the next engine has kept its own times all along
+            for (size_t lane = 0; lane < delayEngine->delayLines.size(); ++lane)
+                nextDelayEngine->delayLines[lane].takeTimingFrom(delayEngine->delayLines[lane]);
+
+        delayEngines.retire(delayEngine);
+        delayEngine = nextDelayEngine;
+        nextDelayEngine = nullptr;
+        handoverDelayScale = 1.f;
+    }
+
+    if (nextReverbEngine != nullptr && reverbHandover.advance(numSamples))
+    {
+        reverbEngines.retire(reverbEngine);
+        reverbEngine = nextReverbEngine;
+        nextReverbEngine = nullptr;
+    }
+}
+
+// True while a stage's mix is above 0 or on its way somewhere
+[[nodiscard]] bool DelayAudioProcessor::isStageActive(const juce::LinearSmoothedValue<float>& mix)
+{
+    return mix.isSmoothing() || mix.getCurrentValue() != 0.f;
+}
+
 [[nodiscard]] float DelayAudioProcessor::applyOnePoleFilter(float current, float next, float coefficient)
 {
     return next + ((next - current) * coefficient);
 }
 
+[[nodiscard]] double DelayAudioProcessor::applyOnePoleFilter(double current, double next, double coefficient)
+{
+    return next + ((next - current) * coefficient);
+}
+
 void DelayAudioProcessor::toggleButtonStateMixes(bool lowPass, bool highPass, bool chorus, bool reverb)
 {
     targetLowPassMix = lowPass ? 1.0f : 0.0f;
@@ -415,6 +813,13 @@ ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& apvts) {
     settings.highPass = apvts.getRawParameterValue("High Pass")->load() > 0.5f;
     settings.reverb = apvts.getRawParameterValue("Reverb")->load() > 0.5f;
     settings.reverbLevel = apvts.getRawParameterValue("Reverb Level")->load();
+    settings.svfFilters = apvts.getRawParameterValue("SVF Filters")->load() > 0.5f;
+    settings.interpolationQuality = static_cast<int>(apvts.getRawParameterValue("Interpolation")->load());
+    settings.reverbRate = static_cast<int>(apvts.getRawParameterValue("Reverb Rate")->load());
+    settings.delayStorage = static_cast<int>(apvts.getRawParameterValue("Delay Storage")->load());
+    settings.delayFormat = static_cast<int>(apvts.getRawParameterValue("Delay Format")->load());
+    settings.longDelay = apvts.getRawParameterValue("Long Delay")->load() > 0.5f;
+    settings.longDelayMemory = static_cast<int>(apvts.getRawParameterValue("Long Delay Memory")->load());
 
     return settings;
 }
@@ -429,19 +834,42 @@ juce::AudioProcessorValueTreeState::ParameterLayout DelayAudioProcessor::createP
     //     noteStringArray.add(div);
     // }
 
-    params.push_back(std::make_unique<juce::AudioParameterInt>("Delay Left", "Delay Left", 0, 2000, 320));
-    params.push_back(std::make_unique<juce::AudioParameterInt>("Delay Right", "Delay Right", 0, 2000, 320));
+    // "Long Delay" stretches the delay time range by getDelayTimeScale; the delay times read out (and are typed in) as
+    // the milliseconds they come to
+    auto longDelay = std::make_unique<juce::AudioParameterBool>("Long Delay", "Long Delay", false);
+    const auto delayTimeAttributes = juce::AudioParameterIntAttributes()
+        .withLabel("ms")
+        .withStringFromValueFunction([longDelay = longDelay.get()](int value, int)
+        {
+            return juce::String(juce::roundToInt(static_cast<float>(value) * getDelayTimeScale(longDelay->get())));
+        })
+        .withValueFromStringFunction([longDelay = longDelay.get()](const juce::String& text)
+        {
+            return juce::roundToInt(text.getFloatValue() / getDelayTimeScale(longDelay->get()));
+        });
+
+    params.push_back(std::make_unique<juce::AudioParameterInt>("Delay Left", "Delay Left", 0, static_cast<int>(maxDelayTime), 320, delayTimeAttributes));
+    params.push_back(std::make_unique<juce::AudioParameterInt>("Delay Right", "Delay Right", 0, static_cast<int>(maxDelayTime), 320, delayTimeAttributes));
     params.push_back(std::make_unique<juce::AudioParameterFloat>("Feedback", "Feedback", juce::NormalisableRange<float>(0.f, 1.f, 0.01f, 1.f), 0.25f));
     params.push_back(std::make_unique<juce::AudioParameterFloat>("Dry Wet", "Dry Wet", juce::NormalisableRange<float>(0.f, 1.f, 0.02f, 1.f), 0.5f));
     params.push_back(std::make_unique<juce::AudioParameterBool>("Dual Delay", "Dual Delay", false));
     params.push_back(std::make_unique<juce::AudioParameterBool>("Chorus", "Chorus", false));
     params.push_back(std::make_unique<juce::AudioParameterFloat>("Chorus Rate", "Chorus Rate", juce::NormalisableRange<float>(0.1f, 3.f, 0.01f, 1.f), 0.45f));
     params.push_back(std::make_unique<juce::AudioParameterBool>("Low Pass", "Low Pass", false));
-    params.push_back(std::make_unique<juce::AudioParameterFloat>("Low Pass Freq", "Low Pass Freq", juce::NormalisableRange<float>(20.f, 7000.f, 1.f, 0.25f), 2000.f));
+    params.push_back(std::make_unique<juce::AudioParameterFloat>("Low Pass Freq", "Low Pass Freq", juce::NormalisableRange<float>(Filters::minCutoff, Filters::maxLowPassCutoff, 1.f, 0.25f), 2000.f));
     params.push_back(std::make_unique<juce::AudioParameterBool>("High Pass", "High Pass", false));
-    params.push_back(std::make_unique<juce::AudioParameterFloat>("High Pass Freq", "High Pass Freq", juce::NormalisableRange<float>(20.f, 1000.f, 1.f, 0.25f), 500.f));
+    params.push_back(std::make_unique<juce::AudioParameterFloat>("High Pass Freq", "High Pass Freq", juce::NormalisableRange<float>(Filters::minCutoff, Filters::maxHighPassCutoff, 1.f, 0.25f), 500.f));
     params.push_back(std::make_unique<juce::AudioParameterBool>("Reverb", "Reverb", false));
     params.push_back(std::make_unique<juce::AudioParameterFloat>("Reverb Level", "Reverb Level", juce::NormalisableRange<float>(0.f, 1.f, 0.02f, 1.f), 0.5f));
+    params.push_back(std::make_unique<juce::AudioParameterBool>("SVF Filters", "SVF Filters", false));
+    params.push_back(std::make_unique<juce::AudioParameterChoice>("Interpolation", "Interpolation",
+                                                                  juce::StringArray { "None", "Linear", "Cubic", "Lagrange", "Thiran" }, 1));
+    params.push_back(std::make_unique<juce::AudioParameterChoice>("Reverb Rate", "Reverb Rate", juce::StringArray { "Full", "Half", "Quarter" }, 0));
+    params.push_back(std::make_unique<juce::AudioParameterChoice>("Delay Storage", "Delay Storage", juce::StringArray { "Full", "Half", "Quarter" }, 0));
+    // half the delay memory for some CPU and noise; Int 16's floor is fixed near -89 dBFS, so quiet tails lose most
+    params.push_back(std::make_unique<juce::AudioParameterChoice>("Delay Format", "Delay Format", juce::StringArray { "Float 32", "Float 16", "BFloat 16", "Int 16" }, 0));
+    params.push_back(std::move(longDelay));
+    params.push_back(std::make_unique<juce::AudioParameterChoice>("Long Delay Memory", "Long Delay Memory", juce::StringArray { "Paged", "Mapped File" }, 0));
 
     //params.push_back(std::make_unique<juce::AudioParameterChoice>("Divisions", "Divisions", noteStringArray, 0));
 
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "Arena.h"
 #include "DelayLine.h"
 #include "ReverbLines.h"
+#include "Engine.h"
 #include "Filters.h"
+#include "Oscillators.h"
 
 struct ChainSettings {
 	float delayTimeLeft {0};
@@ -19,13 +22,21 @@ struct ChainSettings {
 	bool highPass {false};
 	bool reverb {false};
 	float reverbLevel {0};
+	bool svfFilters {false};
+	int interpolationQuality {1};		// index into Interpolation::Quality, linear by default
+	int reverbRate {0};					// reverb lines run at the host rate divided by 1 << reverbRate
+	int delayStorage {0};				// delay memory holds the feedback signal decimated by 1 << delayStorage
+	int delayFormat {0};				// index into StorageCodec::Format
+	bool longDelay {false};				// "Delay Left" / "Delay Right" span up to maxLongDelayTime instead of maxDelayTime
+	int longDelayMemory {0};			// long delays in paged memory (0) or a mapped temp file (1)
 };
 
 ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& apvts);
 
 //==============================================================================
 
-class DelayAudioProcessor  : public juce::AudioProcessor
+class DelayAudioProcessor  : public juce::AudioProcessor,
+                             private juce::Timer
                             #if JucePlugin_Enable_ARA
                              , public juce::AudioProcessorARAExtension
                             #endif
@@ -76,20 +87,64 @@ public:
 	float getCurrentBPM();
 	float getInputSignalLevel() const { return inputSignalLevel; }
 	float getOutputSignalLevel() const { return outputSignalLevel; }
+	size_t getDspMemorySize() const { return arena.getUsedBytes() + delayEngines.getUsedBytes() + reverbEngines.getUsedBytes(); }	// bytes of DSP state in the arenas; long-delay memory is held outside them
+	[[nodiscard]] static float getDelayBufferTime(bool longDelay) { return (longDelay ? maxLongDelayTime : maxDelayTime) + 2.0f * chorusDepth + 1.0f; }	// ms a delay line holds: chorus adds to both the target and the read, plus smoothing overshoot
 
 private:
 	ApplicationProperties appProperties;
 
-	[[nodiscard]] float applyChorus(int sample, float currentMixValue, DelayLine& delayLine, float newDelayTime);
+	template <int numLanes>
+	void processSubBlock(float* const* channelData, int start, int numSamples, const std::array<float, 2>& newDelayTimes, const std::array<float, 2>& dryWets, float& inputPeak, float& outputPeak);
+	[[nodiscard]] double applyChorus(float currentMixValue, DelayLine& delayLine, float newDelayTime);
+	[[nodiscard]] static bool isStageActive(const juce::LinearSmoothedValue<float>& mix);
 	[[nodiscard]] float applyOnePoleFilter(float current, float next, float coefficient);
+	[[nodiscard]] double applyOnePoleFilter(double current, double next, double coefficient);
 	[[nodiscard]] float setDryWetMix(float newDelayTime, float dryWet, float newDryWet, SmoothedValue<float, ValueSmoothingTypes::Linear>& smoothedDryWet);
 	void toggleButtonStateMixes(bool lowPass, bool highPass, bool chorus, bool reverb);
+	DelayEngine::Layout getDelayLayout(const ChainSettings& settings, double sampleRate) const;
+	[[nodiscard]] static float getDelayTimeScale(bool longDelay) { return longDelay ? maxLongDelayTime / maxDelayTime : 1.0f; }	// ms per step of "Delay Left" / "Delay Right"
+	void adoptEngines(const std::array<float, 2>& newDelayTimes);
+	void advanceHandovers(int numSamples);
+	void skipBlock(const std::array<float, 2>& newDelayTimes, int numLanes, int numSamples);
+	void timerCallback() override;
 
 	juce::LinearSmoothedValue<float> smoothedFeedback, smoothedDryWet, smoothedLowPassMix, smoothedHighPassMix, smoothedChorus, smoothedReverb, smoothedReverbLevel;
 
-	std::unique_ptr<DelayLine> leftDelay, rightDelay;
-	std::unique_ptr<ReverbLines> reverbLines;
-	std::unique_ptr<Filters> filters;
+	static constexpr float maxDelayTime = 2000.f;	// ms, upper bound of "Delay Left" / "Delay Right"
+	static constexpr float maxLongDelayTime = 60000.f;	// ms, the same with "Long Delay" on
+	static constexpr int serviceInterval = 50;		// ms between top-ups of the paged delay memory and checks for engine changes
+	static constexpr int subBlockSize = 64;		// host blocks are processed in spans of at most this many samples
+	std::array<std::array<float, subBlockSize>, 2> wetSamples, reverbSamples;		// [left, right] lanes side by side
+	std::array<std::array<double, subBlockSize>, 2> delayTimes, nextDelayTimes;		// ms, then samples; double keeps the fraction at long delays
+	std::array<std::array<float, subBlockSize>, 2> nextReverbSamples;	// the next reverb engine's, while it is handed over to
+	std::array<float, subBlockSize> lowPassMixes, highPassMixes, reverbLfoValues, filteredSamples, handoverFades;
+	std::array<StateVariableFilter::Coefficients, subBlockSize> lowPassSvfCoefficients, highPassSvfCoefficients;
+	bool useStateVariableFilters = false;		// "SVF Filters": per-sample cutoff glide instead of per-span biquad updates
+	float lowPassCutoff = 2000.f, highPassCutoff = 500.f;	// Hz, "Low Pass Freq" / "High Pass Freq" as of this block
+	bool lowPassRunning = false, highPassRunning = false, reverbRunning = false;	// stages that ran in the last span (see processSubBlock)
+	Interpolation::Quality interpolationQuality = Interpolation::Quality::linear;
+
+	DspArena arena;								// the filters, laid out by prepareToPlay
+	Filters* filters = nullptr;
+	double preparedSampleRate = 0.0;			// what the filters, LFOs and smoothers were set up for; 0 before prepareToPlay
+
+	//== ENGINES (see Engine.h; the pointers belong to the audio thread)
+	EngineBuilder<DelayEngine> delayEngines;
+	EngineBuilder<ReverbEngine> reverbEngines;
+	DelayEngine* delayEngine = nullptr;
+	DelayEngine* nextDelayEngine = nullptr;		// being handed over to, while delayHandover runs
+	ReverbEngine* reverbEngine = nullptr;		// nullptr until "Reverb" is first on
+	ReverbEngine* nextReverbEngine = nullptr;
+	Handover delayHandover, reverbHandover;
+	float handoverDelayScale = 1.f;				// the next delay engine's delay times over the current one's; not 1 while "Long Delay" changes
+	std::atomic<bool> reverbRequested { false };	// audio thread -> timer: build the reverb lines
+	std::atomic<double> engineSampleRate { 0.0 };	// prepareToPlay -> timer: the rate engines are built for; 0 while released
+
+	//== SLEEP (see processBlock)
+	static constexpr float silenceThreshold = 1.0e-6f;	// -120 dBFS; quieter input, echoes and reverb count as silence
+	juce::int64 quietSamples = 0;				// how long they have all stayed below it
+	bool asleep = false;						// quiet for longer than any buffer reaches back: the sample loops are skipped
+
 	double currentSampleRate;
 	
 	float currentLowPassMix, targetLowPassMix, currentHighPassMix, targetHighPassMix, targetChorusMix, currentReverbMix, targetReverbMix = 0.f;
@@ -106,10 +161,12 @@ private:
 	float reverbLevel;
 
 	float chorusRate = 0.45f; 
-	float chorusDepth = 0.33f;
-	float chorusPhase = 0.f;
+	static constexpr float chorusDepth = 0.33f;
 	float chorusModulation = 0.f;
 
+	enum { chorusLfo, reverbLfo, numLfos };
+	LfoBank<numLfos> lfos;
+
 	float inputSignalLevel;
 	float outputSignalLevel;
 
@@ -1,66 +1,141 @@
 #pragma once
 
 #include "PluginProcessor.h"
-#include "DelayLine.h"
+#include "Filters.h"
 
+// Structure-of-arrays reverb: every line of both channels is a lane. Delay memory lives in one block of a
+// DspArena (one power-of-two region per lane), and the per-lane biquad states are contiguous, aligned lane arrays.
+// Each processing step is a fixed-length loop over the lanes, which the compiler vectorizes 4 or 8 lanes
+// at a time (SSE/AVX, NEON on ARM).
 class ReverbLines {
 public:
-    ReverbLines(double sampleRate) : currentSampleRate(sampleRate),
-    coeff(1.0f - static_cast<float>(std::exp(-1.0f / (0.01f * sampleRate))))
+    static constexpr int numLines = 10;                                 // per channel
+    static constexpr int numLanes = 2 * numLines;                       // [left lines, right lines]
+    static constexpr int numPaddedLanes = 24;                           // multiple of 8 so no lane loop has a scalar tail
+    static constexpr int numStages = 6;                                 // five all-passes, then the low-pass
+    static constexpr float reverbModRate = 0.005f;
+    static constexpr float reverbModDepth = 0.005f;
+
+    static constexpr int maxRateStages = 2;                             // run at 1/2 or 1/4 of the host rate
+    static constexpr double minReducedRate = 22050.0;                   // keeps the 5 kHz all-pass well below Nyquist
+
+    // rateDivisor (1, 2 or 4) runs the lines at a fraction of the host rate behind half-band decimation and
+    // interpolation. Everything the lines carry is below the 3277 Hz low-pass, so little is lost, and the
+    // resampling latency is taken off the line delays so the path stays latency-free.
+    ReverbLines(double sampleRate, int rateDivisor, DspArena& arena) : decimation(getUsableDecimation(sampleRate, rateDivisor)),
+    currentSampleRate(sampleRate / decimation),
+    coeff(1.0f - static_cast<float>(std::exp(-1.0f / (0.01f * currentSampleRate)))),
+    samplesPerMs(static_cast<float>(currentSampleRate / 1000.0)),
+    modDepthInSamples((reverbModDepth / 1000.0f) * static_cast<float>(sampleRate)),
+    resamplingLatencyMs(static_cast<float>(2 * HalfBand::centre * (decimation - 1) * 1000.0 / sampleRate)),
+    delayRampLength(static_cast<int>(std::floor(0.7 * currentSampleRate)))
     {
+        while ((1 << numRateStages) < decimation)
+            ++numRateStages;
+
+        lineLength = getLineLength(sampleRate, rateDivisor);
+        wrapMask = lineLength - 1;
+        delayMemory = arena.allocate<float>(static_cast<size_t>(numLanes) * lineLength);
         setupDelaysAndFilters();
     }
 
+    // Power-of-two line length for the longest line plus the LFO excursion, at the rate the lines will run
+    static unsigned int getLineLength(double sampleRate, int rateDivisor)
+    {
+        const float lineSamplesPerMs = static_cast<float>(sampleRate / getUsableDecimation(sampleRate, rateDivisor) / 1000.0);
+        const float maxDelayTime = juce::jmax(*std::max_element(fixedDelayTimesLeft.begin(), fixedDelayTimesLeft.end()),
+                                              *std::max_element(fixedDelayTimesRight.begin(), fixedDelayTimesRight.end()))
+                                 + (reverbModDepth / 1000.0f) * static_cast<float>(sampleRate);
+        return static_cast<unsigned int>(juce::nextPowerOfTwo(static_cast<int>(std::ceil(maxDelayTime * lineSamplesPerMs)) + 2));
+    }
+
+    // What the constructor takes from the arena: the object and its delay lines
+    static size_t getArenaBytes(double sampleRate, int rateDivisor)
+    {
+        return DspArena::getBytesFor<ReverbLines>() + DspArena::getBytesFor<float>(static_cast<size_t>(numLanes) * getLineLength(sampleRate, rateDivisor));
+    }
+
+    // ms of signal the lines hold, resampling included
+    float getMemoryTime() const
+    {
+        return static_cast<float>(lineLength) / samplesPerMs + resamplingLatencyMs;
+    }
+
+    static int getUsableDecimation(double sampleRate, int rateDivisor)
+    {
+        int usable = 1;
+        while (usable < rateDivisor && usable < (1 << maxRateStages) && sampleRate / (usable * 2) >= minReducedRate)
+            usable *= 2;
+        return usable;
+    }
+
     void setupDelaysAndFilters()
     {
-        juce::dsp::IIR::Coefficients<float>::Ptr coefficientsLowReverb = juce::dsp::IIR::Coefficients<float>::makeLowPass(currentSampleRate, 3277);  
-        juce::dsp::IIR::Coefficients<float>::Ptr coefficientsAllPass1 = juce::dsp::IIR::Coefficients<float>::makeAllPass(currentSampleRate, 500, 0.55f);
-        juce::dsp::IIR::Coefficients<float>::Ptr coefficientsAllPass2 = juce::dsp::IIR::Coefficients<float>::makeAllPass(currentSampleRate, 1500, 0.575f);
-        juce::dsp::IIR::Coefficients<float>::Ptr coefficientsAllPass3 = juce::dsp::IIR::Coefficients<float>::makeAllPass(currentSampleRate, 2500, 0.6f);
-        juce::dsp::IIR::Coefficients<float>::Ptr coefficientsAllPass4 = juce::dsp::IIR::Coefficients<float>::makeAllPass(currentSampleRate, 4000, 0.65f);
-        juce::dsp::IIR::Coefficients<float>::Ptr coefficientsAllPass5 = juce::dsp::IIR::Coefficients<float>::makeAllPass(currentSampleRate, 5000, 0.7f);
-
-        for (size_t i = 0; i < reverbDelaysLeft.size(); ++i) {
-            reverbDelaysLeft[i] = std::make_unique<DelayLine>(currentSampleRate);
-            reverbDelaysRight[i] = std::make_unique<DelayLine>(currentSampleRate);
-            reverbDelaysLeft[i]->resetSmoothedValue(0.7f);
-            reverbDelaysRight[i]->resetSmoothedValue(0.7f);
-            reverbDelaysLeft[i]->makeBuffer();
-            reverbDelaysRight[i]->makeBuffer();
-            reverbLowPassLeft[i].reset();
-            reverbLowPassRight[i].reset();
-            reverbLowPassLeft[i].coefficients = coefficientsLowReverb;
-            reverbLowPassRight[i].coefficients = coefficientsLowReverb;
-            reverbAllPassLeft1[i].reset();
-            reverbAllPassRight1[i].reset();
-            reverbAllPassLeft1[i].coefficients = coefficientsAllPass1;
-            reverbAllPassRight1[i].coefficients = coefficientsAllPass1;
-            reverbAllPassLeft2[i].reset();
-            reverbAllPassRight2[i].reset();
-            reverbAllPassLeft2[i].coefficients = coefficientsAllPass2;
-            reverbAllPassRight2[i].coefficients = coefficientsAllPass2;
-            reverbAllPassLeft3[i].reset();
-            reverbAllPassRight3[i].reset();
-            reverbAllPassLeft3[i].coefficients = coefficientsAllPass3;
-            reverbAllPassRight3[i].coefficients = coefficientsAllPass3;
-            reverbAllPassLeft4[i].reset();
-            reverbAllPassRight4[i].reset();
-            reverbAllPassLeft4[i].coefficients = coefficientsAllPass4;
-            reverbAllPassRight4[i].coefficients = coefficientsAllPass4;
-            reverbAllPassLeft5[i].reset();
-            reverbAllPassRight5[i].reset();
-            reverbAllPassLeft5[i].coefficients = coefficientsAllPass5;
-            reverbAllPassRight5[i].coefficients = coefficientsAllPass5;
+        coefficients = {
+            Biquad::Coefficients::makeAllPass(currentSampleRate, 500, 0.55f),
+            Biquad::Coefficients::makeAllPass(currentSampleRate, 1500, 0.575f),
+            Biquad::Coefficients::makeAllPass(currentSampleRate, 2500, 0.6f),
+            Biquad::Coefficients::makeAllPass(currentSampleRate, 4000, 0.65f),
+            Biquad::Coefficients::makeAllPass(currentSampleRate, 5000, 0.7f),
+            Biquad::Coefficients::makeLowPass(currentSampleRate, 3277)
+        };
+
+        //== DELAY LINES
+        writeIndex = 0;
+        clear();
+
+        std::fill(delayTimes.begin(), delayTimes.end(), 0.f);
+        std::fill(rampDelayTimes.begin(), rampDelayTimes.end(), 0.f);
+        std::fill(rampSteps.begin(), rampSteps.end(), 0.f);
+        std::fill(decays.begin(), decays.end(), 0.f);
+        std::fill(targetDelayTimes.begin(), targetDelayTimes.end(), 0.f);
+
+        for (int line = 0; line < numLines; ++line)
+        {
+            decays[line] = decays[numLines + line] = 0.9f - 0.01f * static_cast<float>(line);
+            targetDelayTimes[line] = fixedDelayTimesLeft[line] - resamplingLatencyMs;
+            targetDelayTimes[numLines + line] = fixedDelayTimesRight[line] - resamplingLatencyMs;
         }
+
+        rampRemaining = 0;
+        delayRampStarted = false;
+    }
+
+    // Silences the lines, their filters and the resampling, keeping the delay times. Used when the reverb starts
+    // again after being bypassed, so it does not resume the tail it was cut off in.
+    void clear()
+    {
+        std::fill(delayMemory, delayMemory + static_cast<size_t>(numLanes) * lineLength, 0.f);
+
+        for (auto& stageState : state1) std::fill(stageState.begin(), stageState.end(), 0.f);
+        for (auto& stageState : state2) std::fill(stageState.begin(), stageState.end(), 0.f);
+
+        //== RESAMPLING (the output FIFO starts decimation - 1 samples full so every host frame has a sample to read)
+        for (auto& stage : decimators)
+            for (auto& decimator : stage)
+                decimator.reset();
+
+        for (auto& stage : interpolators)
+            for (auto& interpolator : stage)
+                interpolator.reset();
+
+        for (auto& channelFifo : outputFifo)
+            std::fill(channelFifo.begin(), channelFifo.end(), 0.f);
+        fifoReadIndex = 0;
+        fifoWriteIndex = static_cast<unsigned int>(decimation - 1);
     }
 
     void updateTargetDelayTimes()
     {
-        for (size_t i = 0; i < reverbDelaysLeft.size(); ++i)
-        {
-            reverbDelaysLeft[i]->setNewTarget(fixedDelayTimesLeft[i]);
-            reverbDelaysRight[i]->setNewTarget(fixedDelayTimesRight[i]);
-        }
+        if (delayRampStarted)
+            return;
+
+        // lines glide from zero to their fixed delay times over 0.7 s the first time they run
+        for (int lane = 0; lane < numPaddedLanes; ++lane)
+            rampSteps[lane] = (targetDelayTimes[lane] - rampDelayTimes[lane]) / static_cast<float>(delayRampLength);
+
+        rampRemaining = delayRampLength;
+        delayRampStarted = true;
     }
 
     float applyOnePoleFilter(float current, float next, float coefficient)
@@ -68,100 +143,321 @@ public:
         return next + ((next - current) * coefficient);
     }
 
-    float applyReverb(bool left, float sample, float& drywet)
+    // Runs a span of stereo frames through all lanes and writes the combined reverb for each frame.
+    // lfo holds the shared modulation oscillator (-1..1) per frame.
+    void process(const float* left, const float* right, float* reverbLeft, float* reverbRight, int numSamples, float drywet, const float* lfo)
     {
-        std::array<std::unique_ptr<DelayLine>, 10>* reverbDelays;
-        std::array<juce::dsp::IIR::Filter<float>, 10>* reverbLowPass;
-        std::array<juce::dsp::IIR::Filter<float>, 10>* reverbAllPass1;
-        std::array<juce::dsp::IIR::Filter<float>, 10>* reverbAllPass2;
-        std::array<juce::dsp::IIR::Filter<float>, 10>* reverbAllPass3;
-        std::array<juce::dsp::IIR::Filter<float>, 10>* reverbAllPass4;
-        std::array<juce::dsp::IIR::Filter<float>, 10>* reverbAllPass5;
+        if (decimation == 1)
+        {
+            processAtRate(left, right, reverbLeft, reverbRight, numSamples, drywet, lfo);
+            return;
+        }
 
-        if (left)
+        for (int start = 0; start < numSamples; start += maxBlockSize)
         {
-            reverbDelays = &reverbDelaysLeft;
-            reverbLowPass = &reverbLowPassLeft;
-            reverbAllPass1 = &reverbAllPassLeft1;
-            reverbAllPass2 = &reverbAllPassLeft2;
-            reverbAllPass3 = &reverbAllPassLeft3;
-            reverbAllPass4 = &reverbAllPassLeft4;
-            reverbAllPass5 = &reverbAllPassLeft5;
+            const int blockSize = juce::jmin(maxBlockSize, numSamples - start);
+            int numReduced = 0;
+
+            //== DECIMATE (both channels share the decimators' phase)
+            for (int i = start; i < start + blockSize; ++i)
+            {
+                float reducedLeft = left[i];
+                float reducedRight = right[i];
+                bool ready = true;
+
+                for (int stage = 0; ready && stage < numRateStages; ++stage)
+                    ready = decimators[stage][0].process(reducedLeft, reducedLeft) & decimators[stage][1].process(reducedRight, reducedRight);
+
+                if (ready)
+                {
+                    reducedInputs[0][numReduced] = reducedLeft;
+                    reducedInputs[1][numReduced] = reducedRight;
+                    reducedLfo[numReduced] = lfo[i];
+                    ++numReduced;
+                }
+            }
+
+            //== LINES (reduced rate)
+            processAtRate(reducedInputs[0].data(), reducedInputs[1].data(), reducedOutputs[0].data(), reducedOutputs[1].data(),
+                          numReduced, drywet, reducedLfo.data());
+
+            //== INTERPOLATE into the output FIFO, then read the span's frames out of it
+            for (int i = 0; i < numReduced; ++i)
+            {
+                for (int channel = 0; channel < 2; ++channel)
+                    interpolate(channel, reducedOutputs[channel][i]);
+                fifoWriteIndex = (fifoWriteIndex + static_cast<unsigned int>(decimation)) & fifoMask;
+            }
+
+            for (int i = start; i < start + blockSize; ++i)
+            {
+                reverbLeft[i] = outputFifo[0][fifoReadIndex];
+                reverbRight[i] = outputFifo[1][fifoReadIndex];
+                fifoReadIndex = (fifoReadIndex + 1) & fifoMask;
+            }
         }
-        else
+    }
+
+private:
+    static constexpr int maxBlockSize = 64;
+    static constexpr unsigned int fifoMask = 255;                       // > two blocks of host frames plus the priming
+
+    using LaneFrame = std::array<float, numPaddedLanes>;
+
+    // Expands one reduced-rate sample through the interpolator stages (innermost first) into decimation host-rate
+    // samples at the FIFO's write position
+    void interpolate(int channel, float sample)
+    {
+        std::array<float, 1 << maxRateStages> upsampled { sample };
+        std::array<float, 1 << maxRateStages> stageInput;
+        int count = 1;
+
+        for (int stage = numRateStages - 1; stage >= 0; --stage)
         {
-            reverbDelays = &reverbDelaysRight;
-            reverbLowPass = &reverbLowPassRight;
-            reverbAllPass1 = &reverbAllPassRight1;
-            reverbAllPass2 = &reverbAllPassRight2;
-            reverbAllPass3 = &reverbAllPassRight3;
-            reverbAllPass4 = &reverbAllPassRight4;
-            reverbAllPass5 = &reverbAllPassRight5;
+            stageInput = upsampled;
+            for (int i = 0; i < count; ++i)
+                interpolators[stage][channel].process(stageInput[i], upsampled[2 * i], upsampled[2 * i + 1]);
+            count *= 2;
         }
 
-        float reverbDecay = 0.9f;
-        float combinedReverb = 0.0f;
+        for (int i = 0; i < count; ++i)
+            outputFifo[channel][(fifoWriteIndex + static_cast<unsigned int>(i)) & fifoMask] = upsampled[i];
+    }
 
-        //== LFO
-        reverbModPhase += (2.0f * juce::MathConstants<float>::pi * reverbModRate) / static_cast<float>(currentSampleRate);
-        reverbModPhase = std::fmod(reverbModPhase, 2.0f * juce::MathConstants<float>::pi);
-        if (reverbModPhase < 0)
+    void processAtRate(const float* left, const float* right, float* reverbLeft, float* reverbRight, int numSamples, float drywet, const float* lfo)
+    {
+        for (int start = 0; start < numSamples; start += maxBlockSize)
         {
-            reverbModPhase += 2.0 * juce::MathConstants<float>::pi;
+            const int blockSize = juce::jmin(maxBlockSize, numSamples - start);
+            const float shortestDelay = updateDelayTimes(lfo + start, blockSize);
+
+            // lines are at least ~117 ms long, so once the start-up ramp has passed the block length no frame reads
+            // a sample written in the same block and the whole block can be read, filtered and written in stages
+            if (shortestDelay >= static_cast<float>(blockSize - 1))
+            {
+                processBlock(left + start, right + start, reverbLeft + start, reverbRight + start, blockSize, drywet);
+            }
+            else
+            {
+                for (int i = 0; i < blockSize; ++i)
+                    processFrame(left[start + i], right[start + i], reverbLeft[start + i], reverbRight[start + i], drywet, readDelays[i]);
+            }
         }
-        float lfo = std::sin(reverbModPhase);
-        float modDepthInSamples = (reverbModDepth / 1000.0f) * static_cast<float>(currentSampleRate);
-        float modAmount = lfo * modDepthInSamples; 
+    }
 
-        for (size_t i = 0; i < reverbDelays->size(); ++i)
+    // Advances the lane delay times one frame at a time, storing each frame's read delay (samples) in readDelays.
+    // Returns the shortest read delay of the block.
+    float updateDelayTimes(const float* lfo, int blockSize)
+    {
+        float shortestDelay = std::numeric_limits<float>::max();
+
+        for (int i = 0; i < blockSize; ++i)
+        {
+            //== LFO
+            float modAmount = lfo[i] * modDepthInSamples;
+
+            //== DELAY TIMES
+            if (rampRemaining > 0)
+            {
+                if (--rampRemaining > 0)
+                    for (int lane = 0; lane < numPaddedLanes; ++lane)
+                        rampDelayTimes[lane] += rampSteps[lane];
+                else
+                    rampDelayTimes = targetDelayTimes;
+            }
+
+            for (int lane = 0; lane < numPaddedLanes; ++lane)
             {
-                float reverb = (*reverbDelays)[i]->getCurrentDelayTime();
-                reverb += modAmount;
-                reverb = applyOnePoleFilter(reverb, (*reverbDelays)[i]->getSmoothedNext(), coeff);
-                (*reverbDelays)[i]->updateDelayTime(reverb);
-                float delayedReverbSample = (*reverbDelays)[i]->readBufferDelayedSample();
-
-                delayedReverbSample = (*reverbAllPass1)[i].processSample(delayedReverbSample);
-                delayedReverbSample = (*reverbAllPass2)[i].processSample(delayedReverbSample);
-                delayedReverbSample = (*reverbAllPass3)[i].processSample(delayedReverbSample);
-                delayedReverbSample = (*reverbAllPass4)[i].processSample(delayedReverbSample);
-                delayedReverbSample = (*reverbAllPass5)[i].processSample(delayedReverbSample);
-                delayedReverbSample = (*reverbLowPass)[i].processSample(delayedReverbSample);
-
-                (*reverbDelays)[i]->writeDelayBuffer(sample, reverbDecay, delayedReverbSample);
-                combinedReverb += drywet * delayedReverbSample;
-                (*reverbDelays)[i]->updateWriteIndex();
-                reverbDecay -= 0.01f;
+                delayTimes[lane] = applyOnePoleFilter(delayTimes[lane] + modAmount, rampDelayTimes[lane], coeff);
+                readDelays[i][lane] = delayTimes[lane] * samplesPerMs;
             }
 
-        return combinedReverb;
+            for (int lane = 0; lane < numLanes; ++lane)
+                shortestDelay = juce::jmin(shortestDelay, readDelays[i][lane]);
+        }
+
+        return shortestDelay;
     }
 
-private:
-    double currentSampleRate;
+    float readLane(int lane, unsigned int frameWriteIndex, float delayInSamples) const
+    {
+        const unsigned int wholeDelay = static_cast<unsigned int>(delayInSamples);
+        const float fraction = delayInSamples - static_cast<float>(wholeDelay);
+        const float* line = delayMemory + static_cast<size_t>(lane) * lineLength;
+        const unsigned int readIndex = (frameWriteIndex - 1 - wholeDelay) & wrapMask;
+        const float y1 = line[readIndex];
+        return y1 + fraction * (line[(readIndex - 1) & wrapMask] - y1);
+    }
+
+    void prefetchLine(int lane, unsigned int startIndex, int numSamples) const
+    {
+        const float* line = delayMemory + static_cast<size_t>(lane) * lineLength;
+        const unsigned int untilWrap = juce::jmin(static_cast<unsigned int>(numSamples), lineLength - startIndex);
+        prefetchForRead(line + startIndex, untilWrap * sizeof(float));
+        prefetchForRead(line, (static_cast<unsigned int>(numSamples) - untilWrap) * sizeof(float));
+    }
+
+    // One frame: read, filter and write every lane before the next frame (needed while a line is shorter than the block)
+    void processFrame(float left, float right, float& reverbLeft, float& reverbRight, float drywet, const LaneFrame& frameDelays)
+    {
+        alignas(32) LaneFrame delayed;
+        alignas(32) LaneFrame inputs;
+
+        //== READ (gather, one head per lane)
+        for (int lane = 0; lane < numLanes; ++lane)
+            delayed[lane] = readLane(lane, writeIndex, frameDelays[lane]);
+        std::fill(delayed.begin() + numLanes, delayed.end(), 0.f);
+
+        //== ALL-PASS x5 & LOW PASS (transposed direct form II, all lanes per stage)
+        for (int stage = 0; stage < numStages; ++stage)
+        {
+            const Biquad::Coefficients c = coefficients[stage];
+            float* s1 = state1[stage].data();
+            float* s2 = state2[stage].data();
+
+            for (int lane = 0; lane < numPaddedLanes; ++lane)
+            {
+                const float input = delayed[lane];
+                const float output = c.b0 * input + s1[lane];
+                s1[lane] = c.b1 * input - c.a1 * output + s2[lane];
+                s2[lane] = c.b2 * input - c.a2 * output;
+                delayed[lane] = output;
+            }
+        }
+
+        //== WRITE (feedback into each lane's line)
+        std::fill(inputs.begin(), inputs.begin() + numLines, left);
+        std::fill(inputs.begin() + numLines, inputs.end(), right);
+
+        for (int lane = 0; lane < numPaddedLanes; ++lane)
+            inputs[lane] += decays[lane] * delayed[lane];
+
+        for (int lane = 0; lane < numLanes; ++lane)
+            delayMemory[static_cast<size_t>(lane) * lineLength + writeIndex] = inputs[lane];
+
+        writeIndex = (writeIndex + 1) & wrapMask;
+
+        sumLines(delayed, drywet, reverbLeft, reverbRight);
+    }
+
+    // A block of frames in stages: read every lane's block, run each filter stage over the whole block with its
+    // coefficients and lane states held in locals, then write every lane's block back
+    void processBlock(const float* left, const float* right, float* reverbLeft, float* reverbRight, int blockSize, float drywet)
+    {
+        //== READ (lane by lane, so each lane's reads walk forward through its line)
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            for (int i = 0; i < blockSize; ++i)
+                laneBlock[i][lane] = readLane(lane, writeIndex + static_cast<unsigned int>(i), readDelays[i][lane]);
+
+            // the next block of this lane carries on from here; fetch it while the filter stages run
+            const unsigned int nextReadIndex = (writeIndex + static_cast<unsigned int>(blockSize) - 1 - static_cast<unsigned int>(readDelays[blockSize - 1][lane])) & wrapMask;
+            prefetchLine(lane, nextReadIndex, blockSize);
+        }
+
+        for (int i = 0; i < blockSize; ++i)
+            std::fill(laneBlock[i].begin() + numLanes, laneBlock[i].end(), 0.f);
+
+        //== ALL-PASS x5 & LOW PASS
+        for (int stage = 0; stage < numStages; ++stage)
+        {
+            const Biquad::Coefficients c = coefficients[stage];
+            alignas(32) LaneFrame s1 = state1[stage];
+            alignas(32) LaneFrame s2 = state2[stage];
+
+            for (int i = 0; i < blockSize; ++i)
+            {
+                float* delayed = laneBlock[i].data();
+
+                for (int lane = 0; lane < numPaddedLanes; ++lane)
+                {
+                    const float input = delayed[lane];
+                    const float output = c.b0 * input + s1[lane];
+                    s1[lane] = c.b1 * input - c.a1 * output + s2[lane];
+                    s2[lane] = c.b2 * input - c.a2 * output;
+                    delayed[lane] = output;
+                }
+            }
+
+            state1[stage] = s1;
+            state2[stage] = s2;
+        }
+
+        //== WRITE (each lane's block is contiguous in its line apart from the wrap)
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            float* line = delayMemory + static_cast<size_t>(lane) * lineLength;
+            const float* input = lane < numLines ? left : right;
+
+            for (int i = 0; i < blockSize; ++i)
+                line[(writeIndex + static_cast<unsigned int>(i)) & wrapMask] = input[i] + decays[lane] * laneBlock[i][lane];
+        }
+
+        writeIndex = (writeIndex + static_cast<unsigned int>(blockSize)) & wrapMask;
+
+        for (int i = 0; i < blockSize; ++i)
+            sumLines(laneBlock[i], drywet, reverbLeft[i], reverbRight[i]);
+    }
+
+    void sumLines(const LaneFrame& delayed, float drywet, float& reverbLeft, float& reverbRight) const
+    {
+        std::array<float, 2> combinedReverb { 0.f, 0.f };
+        for (int line = 0; line < numLines; ++line)
+        {
+            combinedReverb[0] += drywet * delayed[line];
+            combinedReverb[1] += drywet * delayed[numLines + line];
+        }
+
+        reverbLeft = combinedReverb[0];
+        reverbRight = combinedReverb[1];
+    }
+
+    //==============================================================================
+
+    int decimation;
+    int numRateStages = 0;
+    double currentSampleRate;                   // the rate the lines run at
     float coeff;
+    float samplesPerMs;
 
-    float reverbModRate = 0.005f;
-    float reverbModDepth = 0.005f;
-    float reverbModPhase = 0.f;
-    float reverbModulation = 0.f;
+    float modDepthInSamples;                    // from the host rate, so the modulation is the same at every line rate
+    float resamplingLatencyMs;
 
-    std::array<std::unique_ptr<DelayLine>, 10> reverbDelaysLeft;
-    std::array<std::unique_ptr<DelayLine>, 10> reverbDelaysRight;
     //const std::array<float, 10> fixedDelayTimesLeft = {33.0f, 42.0f, 55.0f, 77.0f, 86.0f, 121.0f, 133.0f, 143.0f, 152.0f, 168.0f};
     //const std::array<float, 10> fixedDelayTimesRight = {43.0f, 64.0f, 72.0f, 89.0f, 101.0f, 117.0f, 125.0f, 130.0f, 142.0f, 158.0f};
-    const std::array<float, 10> fixedDelayTimesLeft = {182.20f, 164.17f, 149.06f, 136.87f, 127.59f, 121.24f, 117.80f, 117.29f, 119.69f, 125.02f};
-    const std::array<float, 10> fixedDelayTimesRight = {184.03f, 165.81f, 150.55f, 138.24f, 128.87f, 122.45f, 118.98f, 118.46f, 120.89f, 126.27f};
-    std::array<juce::dsp::IIR::Filter<float>, 10> reverbLowPassLeft;
-    std::array<juce::dsp::IIR::Filter<float>, 10> reverbLowPassRight;
-    std::array<juce::dsp::IIR::Filter<float>, 10> reverbAllPassLeft1;
-    std::array<juce::dsp::IIR::Filter<float>, 10> reverbAllPassRight1;
-    std::array<juce::dsp::IIR::Filter<float>, 10> reverbAllPassLeft2;
-    std::array<juce::dsp::IIR::Filter<float>, 10> reverbAllPassRight2;
-    std::array<juce::dsp::IIR::Filter<float>, 10> reverbAllPassLeft3;
-    std::array<juce::dsp::IIR::Filter<float>, 10> reverbAllPassRight3;
-    std::array<juce::dsp::IIR::Filter<float>, 10> reverbAllPassLeft4;
-    std::array<juce::dsp::IIR::Filter<float>, 10> reverbAllPassRight4;
-    std::array<juce::dsp::IIR::Filter<float>, 10> reverbAllPassLeft5;
-    std::array<juce::dsp::IIR::Filter<float>, 10> reverbAllPassRight5;
+    static constexpr std::array<float, numLines> fixedDelayTimesLeft = {182.20f, 164.17f, 149.06f, 136.87f, 127.59f, 121.24f, 117.80f, 117.29f, 119.69f, 125.02f};
+    static constexpr std::array<float, numLines> fixedDelayTimesRight = {184.03f, 165.81f, 150.55f, 138.24f, 128.87f, 122.45f, 118.98f, 118.46f, 120.89f, 126.27f};
+
+    //== DELAY LINES
+    float* delayMemory = nullptr;               // numLanes lines of lineLength samples, back to back, in the arena
+    unsigned int lineLength = 0;
+    unsigned int wrapMask = 0;
+    unsigned int writeIndex = 0;                // all lanes write together, so they share one write head
+
+    //== LANE STATE
+    alignas(32) std::array<float, numPaddedLanes> delayTimes;         // ms, one-pole smoothed around the ramp
+    alignas(32) std::array<float, numPaddedLanes> rampDelayTimes;
+    alignas(32) std::array<float, numPaddedLanes> rampSteps;
+    alignas(32) std::array<float, numPaddedLanes> targetDelayTimes;
+    alignas(32) std::array<float, numPaddedLanes> decays;
+    alignas(32) std::array<std::array<float, numPaddedLanes>, numStages> state1, state2;
+    std::array<Biquad::Coefficients, numStages> coefficients;
+
+    //== BLOCK SCRATCH (frame-major: one row of lanes per frame)
+    alignas(32) std::array<LaneFrame, maxBlockSize> readDelays;       // samples
+    alignas(32) std::array<LaneFrame, maxBlockSize> laneBlock;
+
+    //== RESAMPLING ([left, right] per stage, outermost stage first)
+    std::array<std::array<HalfBand::Decimator, 2>, maxRateStages> decimators;
+    std::array<std::array<HalfBand::Interpolator, 2>, maxRateStages> interpolators;
+    std::array<std::array<float, maxBlockSize>, 2> reducedInputs, reducedOutputs;
+    std::array<float, maxBlockSize> reducedLfo;
+    std::array<std::array<float, fifoMask + 1>, 2> outputFifo;
+    unsigned int fifoReadIndex = 0;
+    unsigned int fifoWriteIndex = 0;
+
+    int delayRampLength;
+    int rampRemaining = 0;
+    bool delayRampStarted = false;
 };
+